@@ -0,0 +1,550 @@
+#include "apu.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#define CPU_CLOCK 1789773.0
+#define CYCLES_PER_SAMPLE (CPU_CLOCK / APU_SAMPLE_RATE)
+
+static const uint8_t LENGTH_TABLE[32] = {
+    10, 254, 20, 2,  40, 4,  80, 6,  160, 8,  60, 10, 14, 12, 26, 14,
+    12, 16,  24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const uint8_t DUTY_TABLE[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+static const uint8_t TRIANGLE_TABLE[32] = {
+    15, 14, 13, 12, 11, 10, 9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+};
+
+// In CPU cycles
+static const uint16_t NOISE_PERIODS[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const uint16_t DMC_PERIODS[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214,
+    190, 160, 142, 128, 106, 84,  72,  54,
+};
+
+// Frame counter steps, in CPU cycles
+#define FRAME_STEP_1 7457
+#define FRAME_STEP_2 14913
+#define FRAME_STEP_3 22371
+#define FRAME_STEP_4 29829
+#define FRAME_STEP_5 37281
+
+// Non-linear mixer lookup tables, shared by every APU. Filled once, by
+// whichever thread creates the first APU.
+static float pulse_table[31];
+static float tnd_table[203];
+static pthread_once_t mixer_once = PTHREAD_ONCE_INIT;
+
+static void init_mixer(void) {
+  for (int i = 1; i < 31; i++) {
+    pulse_table[i] = 95.52f / (8128.0f / (float)i + 100.0f);
+  }
+  for (int i = 1; i < 203; i++) {
+    tnd_table[i] = 163.67f / (24329.0f / (float)i + 100.0f);
+  }
+}
+
+Apu apu_init(void) {
+  pthread_once(&mixer_once, init_mixer);
+
+  Apu apu = {
+      .noise = {.shift = 1, .timer_period = NOISE_PERIODS[0]},
+      .dmc = {.timer_period = DMC_PERIODS[0], .bits = 8, .silence = true},
+  };
+  apu.pulse[0].ones_complement = true;
+
+  return apu;
+}
+
+static void clock_envelope(Envelope* envelope) {
+  if (envelope->start) {
+    envelope->start = false;
+    envelope->decay = 15;
+    envelope->divider = envelope->volume;
+    return;
+  }
+
+  if (envelope->divider) {
+    envelope->divider--;
+    return;
+  }
+
+  envelope->divider = envelope->volume;
+  if (envelope->decay) {
+    envelope->decay--;
+  } else if (envelope->loop) {
+    envelope->decay = 15;
+  }
+}
+
+static uint8_t envelope_volume(const Envelope* envelope) {
+  return envelope->constant ? envelope->volume : envelope->decay;
+}
+
+static uint16_t sweep_target(const Pulse* pulse) {
+  uint16_t change = pulse->timer_period >> pulse->sweep_shift;
+  if (!pulse->sweep_negate) {
+    return (uint16_t)(pulse->timer_period + change);
+  }
+
+  if (change + pulse->ones_complement > pulse->timer_period) {
+    return 0;
+  }
+  return (uint16_t)(pulse->timer_period - change - pulse->ones_complement);
+}
+
+static bool pulse_muted(const Pulse* pulse) {
+  return pulse->timer_period < 8 || sweep_target(pulse) > 0x7FF;
+}
+
+static void clock_sweep(Pulse* pulse) {
+  if (!pulse->sweep_divider && pulse->sweep_enabled && pulse->sweep_shift &&
+      !pulse_muted(pulse)) {
+    pulse->timer_period = sweep_target(pulse);
+  }
+
+  if (!pulse->sweep_divider || pulse->sweep_reload) {
+    pulse->sweep_divider = pulse->sweep_period;
+    pulse->sweep_reload = false;
+  } else {
+    pulse->sweep_divider--;
+  }
+}
+
+static void clock_linear_counter(Triangle* triangle) {
+  if (triangle->linear_reload) {
+    triangle->linear_counter = triangle->linear_period;
+  } else if (triangle->linear_counter) {
+    triangle->linear_counter--;
+  }
+
+  if (!triangle->control) {
+    triangle->linear_reload = false;
+  }
+}
+
+static void clock_length(uint8_t* length, bool halt) {
+  if (*length && !halt) {
+    (*length)--;
+  }
+}
+
+// Envelopes and the triangle's linear counter
+static void quarter_frame(Apu* apu) {
+  clock_envelope(&apu->pulse[0].envelope);
+  clock_envelope(&apu->pulse[1].envelope);
+  clock_envelope(&apu->noise.envelope);
+  clock_linear_counter(&apu->triangle);
+}
+
+// Length counters and sweeps
+static void half_frame(Apu* apu) {
+  for (int i = 0; i < 2; i++) {
+    clock_length(&apu->pulse[i].length, apu->pulse[i].length_halt);
+    clock_sweep(&apu->pulse[i]);
+  }
+  clock_length(&apu->triangle.length, apu->triangle.control);
+  clock_length(&apu->noise.length, apu->noise.length_halt);
+}
+
+static void clock_frame_counter(Apu* apu) {
+  apu->frame_cycle++;
+
+  switch (apu->frame_cycle) {
+    case FRAME_STEP_1:
+    case FRAME_STEP_3:
+      quarter_frame(apu);
+      break;
+    case FRAME_STEP_2:
+      quarter_frame(apu);
+      half_frame(apu);
+      break;
+    case FRAME_STEP_4:
+      if (!apu->five_step) {
+        quarter_frame(apu);
+        half_frame(apu);
+        if (!apu->irq_inhibit) {
+          apu->frame_irq = true;
+        }
+        apu->frame_cycle = 0;
+      }
+      break;
+    case FRAME_STEP_5:
+      quarter_frame(apu);
+      half_frame(apu);
+      apu->frame_cycle = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+static void clock_pulse(Pulse* pulse) {
+  if (pulse->timer) {
+    pulse->timer--;
+    return;
+  }
+
+  pulse->timer = pulse->timer_period;
+  pulse->step = (pulse->step + 1) & 7;
+}
+
+static void clock_triangle(Triangle* triangle) {
+  if (triangle->timer) {
+    triangle->timer--;
+    return;
+  }
+
+  triangle->timer = triangle->timer_period;
+  if (triangle->length && triangle->linear_counter) {
+    triangle->step = (triangle->step + 1) & 31;
+  }
+}
+
+static void clock_noise(Noise* noise) {
+  if (noise->timer) {
+    noise->timer--;
+    return;
+  }
+
+  noise->timer = noise->timer_period - 1;
+  uint16_t feedback =
+      (noise->shift ^ (noise->shift >> (noise->mode ? 6 : 1))) & 1;
+  noise->shift = (uint16_t)(noise->shift >> 1 | feedback << 14);
+}
+
+static void dmc_restart(Dmc* dmc) {
+  dmc->addr = dmc->sample_addr;
+  dmc->remaining = dmc->sample_length;
+}
+
+static void clock_dmc(Dmc* dmc) {
+  if (dmc->timer) {
+    dmc->timer--;
+    return;
+  }
+
+  dmc->timer = dmc->timer_period - 1;
+
+  if (!dmc->silence) {
+    if (dmc->shift & 1) {
+      if (dmc->output <= 125) {
+        dmc->output += 2;
+      }
+    } else if (dmc->output >= 2) {
+      dmc->output -= 2;
+    }
+  }
+  dmc->shift >>= 1;
+
+  if (--dmc->bits == 0) {
+    dmc->bits = 8;
+    dmc->silence = !dmc->buffer_full;
+    if (dmc->buffer_full) {
+      dmc->shift = dmc->buffer;
+      dmc->buffer_full = false;
+    }
+  }
+}
+
+bool apu_dmc_needs_fetch(const Apu* apu) {
+  return !apu->dmc.buffer_full && apu->dmc.remaining;
+}
+
+uint16_t apu_dmc_fetch_addr(const Apu* apu) {
+  return apu->dmc.addr;
+}
+
+void apu_dmc_fill(Apu* apu, uint8_t val) {
+  Dmc* dmc = &apu->dmc;
+  dmc->buffer = val;
+  dmc->buffer_full = true;
+
+  // The address wraps around to $8000, not $0000
+  dmc->addr = dmc->addr == 0xFFFF ? 0x8000 : (uint16_t)(dmc->addr + 1);
+
+  if (--dmc->remaining == 0) {
+    if (dmc->loop) {
+      dmc_restart(dmc);
+    } else if (dmc->irq_enabled) {
+      dmc->irq = true;
+    }
+  }
+}
+
+static uint8_t pulse_output(const Pulse* pulse) {
+  if (!pulse->length || pulse_muted(pulse) ||
+      !DUTY_TABLE[pulse->duty][pulse->step]) {
+    return 0;
+  }
+  return envelope_volume(&pulse->envelope);
+}
+
+static uint8_t noise_output(const Noise* noise) {
+  if (!noise->length || (noise->shift & 1)) {
+    return 0;
+  }
+  return envelope_volume(&noise->envelope);
+}
+
+static float mix(const Apu* apu) {
+  int pulse = pulse_output(&apu->pulse[0]) + pulse_output(&apu->pulse[1]);
+  int tnd = 3 * TRIANGLE_TABLE[apu->triangle.step] +
+            2 * noise_output(&apu->noise) + apu->dmc.output;
+  return pulse_table[pulse] + tnd_table[tnd];
+}
+
+// Box filters the mixer output down to the sample rate, then removes the DC
+// offset with a high pass like the one on the console's output
+static void output_sample(Apu* apu) {
+  apu->sample_sum += mix(apu);
+  apu->sample_sum_count++;
+
+  apu->sample_clock += 1.0;
+  if (apu->sample_clock < CYCLES_PER_SAMPLE) {
+    return;
+  }
+  apu->sample_clock -= CYCLES_PER_SAMPLE;
+
+  float in = apu->sample_sum / (float)apu->sample_sum_count;
+  apu->sample_sum = 0;
+  apu->sample_sum_count = 0;
+
+  float out = in - apu->highpass_in + 0.996f * apu->highpass_out;
+  apu->highpass_in = in;
+  apu->highpass_out = out;
+
+  if (apu->sample_count == apu->sample_capacity) {
+    return;
+  }
+
+  float scaled = out * 32767.0f;
+  if (scaled > 32767.0f) {
+    scaled = 32767.0f;
+  } else if (scaled < -32768.0f) {
+    scaled = -32768.0f;
+  }
+  apu->samples[apu->sample_count++] = (int16_t)scaled;
+}
+
+// One CPU cycle. Pulses and noise run at half the CPU clock.
+void apu_tick(Apu* apu) {
+  clock_frame_counter(apu);
+
+  apu->odd_cycle = !apu->odd_cycle;
+  if (apu->odd_cycle) {
+    clock_pulse(&apu->pulse[0]);
+    clock_pulse(&apu->pulse[1]);
+  }
+  clock_triangle(&apu->triangle);
+  clock_noise(&apu->noise);
+  clock_dmc(&apu->dmc);
+
+  if (apu->samples) {
+    output_sample(apu);
+  }
+}
+
+bool apu_irq(const Apu* apu) {
+  return apu->frame_irq || apu->dmc.irq;
+}
+
+long apu_cycles_to_frame_irq(const Apu* apu) {
+  if (apu->five_step || apu->irq_inhibit || apu->frame_irq) {
+    return -1;
+  }
+
+  return FRAME_STEP_4 - apu->frame_cycle;
+}
+
+long apu_cycles_to_dmc(const Apu* apu) {
+  if (apu_dmc_needs_fetch(apu)) {
+    return 1;
+  }
+
+  // A full buffer is emptied on the clock that shifts out the last bit
+  const Dmc* dmc = &apu->dmc;
+  if (!dmc->buffer_full) {
+    return -1;
+  }
+  return dmc->timer + 1 + (dmc->bits - 1) * dmc->timer_period;
+}
+
+void apu_set_output(Apu* apu, int16_t* samples, int capacity) {
+  apu->samples = samples;
+  apu->sample_capacity = capacity;
+  apu->sample_count = 0;
+}
+
+uint8_t apu_peek_status(const Apu* apu) {
+  return (uint8_t)((apu->pulse[0].length ? 0x01 : 0) |
+                   (apu->pulse[1].length ? 0x02 : 0) |
+                   (apu->triangle.length ? 0x04 : 0) |
+                   (apu->noise.length ? 0x08 : 0) |
+                   (apu->dmc.remaining ? 0x10 : 0) |
+                   (apu->frame_irq ? 0x40 : 0) | (apu->dmc.irq ? 0x80 : 0));
+}
+
+// Reading $4015 acknowledges the frame IRQ
+uint8_t apu_read_status(Apu* apu) {
+  uint8_t status = apu_peek_status(apu);
+  apu->frame_irq = false;
+  return status;
+}
+
+static void write_envelope(Envelope* envelope, uint8_t val) {
+  envelope->loop = val & 0x20;
+  envelope->constant = val & 0x10;
+  envelope->volume = val & 0x0F;
+}
+
+static void write_pulse(Pulse* pulse, int reg, uint8_t val) {
+  switch (reg) {
+    case 0:
+      pulse->duty = val >> 6;
+      pulse->length_halt = val & 0x20;
+      write_envelope(&pulse->envelope, val);
+      break;
+    case 1:
+      pulse->sweep_enabled = val & 0x80;
+      pulse->sweep_period = (val >> 4) & 7;
+      pulse->sweep_negate = val & 0x08;
+      pulse->sweep_shift = val & 7;
+      pulse->sweep_reload = true;
+      break;
+    case 2:
+      pulse->timer_period = (uint16_t)((pulse->timer_period & 0x700) | val);
+      break;
+    default:
+      pulse->timer_period =
+          (uint16_t)((pulse->timer_period & 0xFF) | (val & 7) << 8);
+      if (pulse->enabled) {
+        pulse->length = LENGTH_TABLE[val >> 3];
+      }
+      pulse->step = 0;
+      pulse->envelope.start = true;
+      break;
+  }
+}
+
+void apu_write(Apu* apu, uint16_t addr, uint8_t val) {
+  Triangle* triangle = &apu->triangle;
+  Noise* noise = &apu->noise;
+  Dmc* dmc = &apu->dmc;
+
+  switch (addr) {
+    case 0x4000:
+    case 0x4001:
+    case 0x4002:
+    case 0x4003:
+    case 0x4004:
+    case 0x4005:
+    case 0x4006:
+    case 0x4007:
+      write_pulse(&apu->pulse[(addr >> 2) & 1], addr & 3, val);
+      break;
+
+    case 0x4008:
+      triangle->control = val & 0x80;
+      triangle->linear_period = val & 0x7F;
+      break;
+    case 0x400A:
+      triangle->timer_period = (uint16_t)((triangle->timer_period & 0x700) | val);
+      break;
+    case 0x400B:
+      triangle->timer_period =
+          (uint16_t)((triangle->timer_period & 0xFF) | (val & 7) << 8);
+      if (triangle->enabled) {
+        triangle->length = LENGTH_TABLE[val >> 3];
+      }
+      triangle->linear_reload = true;
+      break;
+
+    case 0x400C:
+      noise->length_halt = val & 0x20;
+      write_envelope(&noise->envelope, val);
+      break;
+    case 0x400E:
+      noise->mode = val & 0x80;
+      noise->timer_period = NOISE_PERIODS[val & 0x0F];
+      break;
+    case 0x400F:
+      if (noise->enabled) {
+        noise->length = LENGTH_TABLE[val >> 3];
+      }
+      noise->envelope.start = true;
+      break;
+
+    case 0x4010:
+      dmc->irq_enabled = val & 0x80;
+      dmc->loop = val & 0x40;
+      dmc->timer_period = DMC_PERIODS[val & 0x0F];
+      if (!dmc->irq_enabled) {
+        dmc->irq = false;
+      }
+      break;
+    case 0x4011:
+      dmc->output = val & 0x7F;
+      break;
+    case 0x4012:
+      dmc->sample_addr = (uint16_t)(0xC000 | val << 6);
+      break;
+    case 0x4013:
+      dmc->sample_length = (uint16_t)(val << 4 | 1);
+      break;
+
+    case 0x4015:
+      apu->pulse[0].enabled = val & 0x01;
+      apu->pulse[1].enabled = val & 0x02;
+      triangle->enabled = val & 0x04;
+      noise->enabled = val & 0x08;
+      dmc->enabled = val & 0x10;
+
+      // Disabling a channel silences it right away
+      if (!apu->pulse[0].enabled) {
+        apu->pulse[0].length = 0;
+      }
+      if (!apu->pulse[1].enabled) {
+        apu->pulse[1].length = 0;
+      }
+      if (!triangle->enabled) {
+        triangle->length = 0;
+      }
+      if (!noise->enabled) {
+        noise->length = 0;
+      }
+      if (!dmc->enabled) {
+        dmc->remaining = 0;
+      } else if (!dmc->remaining) {
+        dmc_restart(dmc);
+      }
+      dmc->irq = false;
+      break;
+
+    case 0x4017:
+      apu->five_step = val & 0x80;
+      apu->irq_inhibit = val & 0x40;
+      if (apu->irq_inhibit) {
+        apu->frame_irq = false;
+      }
+      apu->frame_cycle = 0;
+      if (apu->five_step) {
+        quarter_frame(apu);
+        half_frame(apu);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
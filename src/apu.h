@@ -0,0 +1,129 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define APU_SAMPLE_RATE 44100
+
+typedef struct Envelope {
+  bool start;
+  bool loop;
+  bool constant;
+  uint8_t volume;
+  uint8_t divider;
+  uint8_t decay;
+} Envelope;
+
+typedef struct Pulse {
+  bool enabled;
+  // Pulse 1 negates the sweep with one's complement
+  bool ones_complement;
+
+  uint8_t duty;
+  uint8_t step;
+  uint16_t timer_period;
+  uint16_t timer;
+
+  uint8_t length;
+  bool length_halt;
+  Envelope envelope;
+
+  bool sweep_enabled;
+  bool sweep_negate;
+  bool sweep_reload;
+  uint8_t sweep_period;
+  uint8_t sweep_shift;
+  uint8_t sweep_divider;
+} Pulse;
+
+typedef struct Triangle {
+  bool enabled;
+  bool control;
+  bool linear_reload;
+  uint8_t linear_period;
+  uint8_t linear_counter;
+
+  uint8_t step;
+  uint16_t timer_period;
+  uint16_t timer;
+  uint8_t length;
+} Triangle;
+
+typedef struct Noise {
+  bool enabled;
+  bool mode;
+  uint16_t shift;
+  uint16_t timer_period;
+  uint16_t timer;
+
+  uint8_t length;
+  bool length_halt;
+  Envelope envelope;
+} Noise;
+
+typedef struct Dmc {
+  bool enabled;
+  bool irq_enabled;
+  bool irq;
+  bool loop;
+
+  uint16_t timer_period;
+  uint16_t timer;
+  uint8_t output;
+
+  uint16_t sample_addr;
+  uint16_t sample_length;
+  uint16_t addr;
+  uint16_t remaining;
+
+  uint8_t buffer;
+  bool buffer_full;
+  uint8_t shift;
+  uint8_t bits;
+  bool silence;
+} Dmc;
+
+typedef struct Apu {
+  Pulse pulse[2];
+  Triangle triangle;
+  Noise noise;
+  Dmc dmc;
+
+  // Frame counter
+  bool five_step;
+  bool irq_inhibit;
+  bool frame_irq;
+  long frame_cycle;
+  bool odd_cycle;
+
+  // Samples go here when set, nothing is mixed otherwise
+  int16_t* samples;
+  int sample_capacity;
+  int sample_count;
+
+  double sample_clock;
+  float sample_sum;
+  int sample_sum_count;
+  float highpass_in;
+  float highpass_out;
+} Apu;
+
+Apu apu_init(void);
+
+void apu_tick(Apu* apu);
+bool apu_irq(const Apu* apu);
+// CPU cycles until the frame counter raises its IRQ, -1 if it won't
+long apu_cycles_to_frame_irq(const Apu* apu);
+// CPU cycles until the DMC may want a sample byte, -1 when it is idle
+long apu_cycles_to_dmc(const Apu* apu);
+
+// The DMC wants its next sample byte, the bus fetches it and stalls the CPU
+bool apu_dmc_needs_fetch(const Apu* apu);
+uint16_t apu_dmc_fetch_addr(const Apu* apu);
+void apu_dmc_fill(Apu* apu, uint8_t val);
+
+// Point the mixer at a sample buffer, or NULL to skip mixing entirely
+void apu_set_output(Apu* apu, int16_t* samples, int capacity);
+
+uint8_t apu_read_status(Apu* apu);
+uint8_t apu_peek_status(const Apu* apu);
+void apu_write(Apu* apu, uint16_t addr, uint8_t val);
@@ -0,0 +1,185 @@
+#include "breakpoint.h"
+#include "bus.h"
+#include "cpu.h"
+#include <string.h>
+
+static bool map_test(const uint8_t* map, uint16_t addr) {
+  return map[addr >> 3] & (1 << (addr & 7));
+}
+
+static void map_set(uint8_t* map, uint16_t addr) {
+  map[addr >> 3] |= (uint8_t)(1 << (addr & 7));
+}
+
+static void map_clear(uint8_t* map, uint16_t addr) {
+  map[addr >> 3] &= (uint8_t) ~(1 << (addr & 7));
+}
+
+// The bus and CPU only look at the breakpoints when something is armed or
+// the CPU is stopped, so an empty set costs nothing on the hot path
+static void update_active(Breakpoints* bp) {
+  bool active = bp->stopped || bp->exec_count || bp->watchpoint_count ||
+                bp->cycle_target >= 0;
+  bp->bus->breakpoints = active ? bp : NULL;
+}
+
+// Watchpoints can overlap, so rebuild the maps from the list after a removal
+static void rebuild_watch_maps(Breakpoints* bp) {
+  memset(bp->read_map, 0, sizeof(bp->read_map));
+  memset(bp->write_map, 0, sizeof(bp->write_map));
+
+  for (int i = 0; i < bp->watchpoint_count; i++) {
+    Watchpoint* watch = &bp->watchpoints[i];
+    for (uint32_t addr = watch->start; addr <= watch->end; addr++) {
+      if (watch->kind & WatchRead) {
+        map_set(bp->read_map, (uint16_t)addr);
+      }
+      if (watch->kind & WatchWrite) {
+        map_set(bp->write_map, (uint16_t)addr);
+      }
+    }
+  }
+}
+
+void breakpoints_init(Breakpoints* bp, Bus* bus) {
+  memset(bp, 0, sizeof(*bp));
+  bp->bus = bus;
+  bp->cycle_target = -1;
+  update_active(bp);
+}
+
+bool breakpoint_add(Breakpoints* bp, uint16_t addr) {
+  if (map_test(bp->exec_map, addr)) {
+    return false;
+  }
+
+  map_set(bp->exec_map, addr);
+  bp->exec_count++;
+  update_active(bp);
+  return true;
+}
+
+bool breakpoint_remove(Breakpoints* bp, uint16_t addr) {
+  if (!map_test(bp->exec_map, addr)) {
+    return false;
+  }
+
+  map_clear(bp->exec_map, addr);
+  bp->exec_count--;
+  update_active(bp);
+  return true;
+}
+
+bool watchpoint_add(Breakpoints* bp, Watchpoint watch) {
+  if (bp->watchpoint_count == MAX_WATCHPOINTS || watch.end < watch.start) {
+    return false;
+  }
+
+  bp->watchpoints[bp->watchpoint_count++] = watch;
+  rebuild_watch_maps(bp);
+  update_active(bp);
+  return true;
+}
+
+bool watchpoint_remove(Breakpoints* bp, uint16_t start, uint16_t end,
+                       int kind) {
+  for (int i = 0; i < bp->watchpoint_count; i++) {
+    Watchpoint* watch = &bp->watchpoints[i];
+    if (watch->start == start && watch->end == end && watch->kind == kind) {
+      *watch = bp->watchpoints[--bp->watchpoint_count];
+      rebuild_watch_maps(bp);
+      update_active(bp);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void breakpoint_set_cycle(Breakpoints* bp, long cycle) {
+  bp->cycle_target = cycle;
+  update_active(bp);
+}
+
+void breakpoints_stop(Breakpoints* bp, BreakReason reason, uint16_t addr,
+                      uint8_t val) {
+  bp->stopped = true;
+  bp->reason = reason;
+  bp->address = addr;
+  bp->value = val;
+  update_active(bp);
+}
+
+void breakpoints_resume(Breakpoints* bp) {
+  bp->stopped = false;
+  bp->reason = BreakNone;
+  bp->skip_once = true;
+  bp->skip_pc = bp->bus->cpu->pc;
+  update_active(bp);
+}
+
+bool breakpoint_check(Breakpoints* bp, Cpu* cpu) {
+  if (bp->stopped) {
+    return true;
+  }
+
+  if (bp->skip_once) {
+    bp->skip_once = false;
+    if (cpu->pc == bp->skip_pc) {
+      return false;
+    }
+  }
+
+  if (bp->cycle_target >= 0 && cpu->cycles_total >= bp->cycle_target) {
+    bp->cycle_target = -1;
+    breakpoints_stop(bp, BreakCycle, cpu->pc, 0);
+    return true;
+  }
+
+  if (map_test(bp->exec_map, cpu->pc)) {
+    breakpoints_stop(bp, BreakPc, cpu->pc, 0);
+    return true;
+  }
+
+  return false;
+}
+
+void watchpoint_check(Breakpoints* bp, uint16_t addr, uint8_t val, int kind) {
+  const uint8_t* map = kind == WatchRead ? bp->read_map : bp->write_map;
+  if (!map_test(map, addr)) {
+    return;
+  }
+
+  // Only go through the list for value conditions once the map says the
+  // address is watched at all
+  for (int i = 0; i < bp->watchpoint_count; i++) {
+    Watchpoint* watch = &bp->watchpoints[i];
+    if (!(watch->kind & kind) || addr < watch->start || addr > watch->end) {
+      continue;
+    }
+    if (watch->has_value && watch->value != val) {
+      continue;
+    }
+
+    breakpoints_stop(bp, kind == WatchRead ? BreakRead : BreakWrite, addr,
+                     val);
+    return;
+  }
+}
+
+const char* break_reason_name(BreakReason reason) {
+  switch (reason) {
+    case BreakNone:
+      return "none";
+    case BreakPc:
+      return "breakpoint";
+    case BreakRead:
+      return "read watchpoint";
+    case BreakWrite:
+      return "write watchpoint";
+    case BreakCycle:
+      return "cycle breakpoint";
+  }
+
+  return "unknown";
+}
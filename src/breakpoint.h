@@ -0,0 +1,76 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Bus Bus;
+typedef struct Cpu Cpu;
+
+typedef enum BreakReason {
+  BreakNone,
+  BreakPc,
+  BreakRead,
+  BreakWrite,
+  BreakCycle
+} BreakReason;
+
+// Watchpoint kinds, can be or'd together for access watchpoints
+typedef enum WatchKind { WatchRead = 1, WatchWrite = 2 } WatchKind;
+
+#define MAX_WATCHPOINTS 32
+
+typedef struct Watchpoint {
+  uint16_t start;
+  uint16_t end;
+  int kind;
+
+  // Only trigger when the value read/written matches
+  bool has_value;
+  uint8_t value;
+} Watchpoint;
+
+typedef struct Breakpoints {
+  Bus* bus;
+
+  // One bit per CPU address
+  uint8_t exec_map[0x2000];
+  uint8_t read_map[0x2000];
+  uint8_t write_map[0x2000];
+  int exec_count;
+
+  Watchpoint watchpoints[MAX_WATCHPOINTS];
+  int watchpoint_count;
+
+  // Stop once cycles_total reaches this, -1 when unset
+  long cycle_target;
+
+  // Set when execution should halt, cleared by breakpoints_resume
+  bool stopped;
+  BreakReason reason;
+  uint16_t address;
+  uint8_t value;
+
+  // Let the instruction at the resumed PC run once after resuming
+  bool skip_once;
+  uint16_t skip_pc;
+} Breakpoints;
+
+void breakpoints_init(Breakpoints* bp, Bus* bus);
+
+bool breakpoint_add(Breakpoints* bp, uint16_t addr);
+bool breakpoint_remove(Breakpoints* bp, uint16_t addr);
+bool watchpoint_add(Breakpoints* bp, Watchpoint watch);
+bool watchpoint_remove(Breakpoints* bp, uint16_t start, uint16_t end, int kind);
+void breakpoint_set_cycle(Breakpoints* bp, long cycle);
+
+void breakpoints_stop(Breakpoints* bp, BreakReason reason, uint16_t addr,
+                      uint8_t val);
+void breakpoints_resume(Breakpoints* bp);
+
+// Called at every instruction boundary, returns true if the CPU must not
+// execute the instruction at the current PC
+bool breakpoint_check(Breakpoints* bp, Cpu* cpu);
+
+// Called from the bus for every non-peek access
+void watchpoint_check(Breakpoints* bp, uint16_t addr, uint8_t val, int kind);
+
+const char* break_reason_name(BreakReason reason);
@@ -1,17 +1,236 @@
 #include "bus.h"
+#include "breakpoint.h"
+#include "cheats.h"
+#include "coverage.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#ifdef CNES_FLAT_BUS
+
+// Test builds see 64K of plain RAM and nothing else, like the machine the
+// single step CPU test vectors were made on
 Bus bus_init(unsigned char* rom) {
   return (Bus){
+      .rom = rom, .cpu_ram = calloc(0x10000, 1), .next_event = LONG_MAX};
+}
+
+void bus_sync(Bus* bus) { (void)bus; }
+
+void bus_run_events(Bus* bus) { (void)bus; }
+
+uint8_t cartridge_read(Bus* bus, uint16_t addr) { return bus->cpu_ram[addr]; }
+
+long cartridge_prg_offset(Bus* bus, uint16_t addr) {
+  (void)bus;
+  (void)addr;
+  return -1;
+}
+
+uint8_t mem_read(Bus* bus, uint16_t addr) { return bus->cpu_ram[addr]; }
+
+uint8_t mem_fetch(Bus* bus, uint16_t addr) { return bus->cpu_ram[addr]; }
+
+uint16_t mem_read_16(Bus* bus, uint16_t addr) {
+  uint8_t lo = mem_read(bus, addr);
+  uint8_t hi = mem_read(bus, addr + 1);
+
+  return (uint16_t)((hi << 8) | lo);
+}
+
+uint8_t mem_peek(Bus* bus, uint16_t addr) { return bus->cpu_ram[addr]; }
+
+uint16_t mem_peek_16(Bus* bus, uint16_t addr) {
+  uint8_t lo = mem_peek(bus, addr);
+  uint8_t hi = mem_peek(bus, addr + 1);
+
+  return (uint16_t)((hi << 8) | lo);
+}
+
+void mem_write(Bus* bus, uint16_t addr, uint8_t val) {
+  bus->cpu_ram[addr] = val;
+}
+
+void mem_poke(Bus* bus, uint16_t addr, uint8_t val) {
+  bus->cpu_ram[addr] = val;
+}
+
+#else
+
+static void schedule_vblank(Bus* bus);
+static void schedule_apu(Bus* bus);
+
+Bus bus_init(unsigned char* rom) {
+  BusMemory memory = {
+      .cpu_ram = calloc(CPU_RAM_SIZE, 1),
+      .prg_ram = calloc(PRG_RAM_SIZE, 1),
+      .chr_ram = rom[5] ? NULL : calloc(CHR_RAM_SIZE, 1),
+      .framebuffer = calloc(PPU_WIDTH * PPU_HEIGHT, 1),
+  };
+  return bus_init_in(rom, &memory);
+}
+
+Bus bus_init_in(unsigned char* rom, const BusMemory* memory) {
+  Bus bus = {
       .rom = rom,
-      .cpu_ram = calloc(0x0800, 1),
+      .cpu_ram = memory->cpu_ram,
       .mapping_num = (rom[6] >> 4 | (rom[7] & 0b11110000)),
+      .ppu = ppu_init(rom, memory->chr_ram, memory->framebuffer),
+      .apu = apu_init(),
+      .prg_ram = memory->prg_ram,
+      .work_ram = memory->prg_ram,
+      // Only the last bank is known at power on
+      .prg_banks = {0, 1, 2, 3, 4, 5, 6, 0xFF},
   };
+
+  scheduler_init(&bus.scheduler);
+  schedule_vblank(&bus);
+  schedule_apu(&bus);
+  bus.next_event = scheduler_next(&bus.scheduler);
+  return bus;
+}
+
+bool bus_map_save(Bus* bus, const char* path) {
+  bool battery = bus->rom[6] & 0x02;
+  if (!battery) {
+    return true;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+
+  // New or short files are padded with zeroes, longer ones are left as they
+  // are and only their start is mapped
+  struct stat st;
+  bool sized = fstat(fd, &st) == 0 &&
+               (st.st_size >= PRG_RAM_SIZE || ftruncate(fd, PRG_RAM_SIZE) == 0);
+  void* mapped = MAP_FAILED;
+  if (sized) {
+    mapped = mmap(NULL, PRG_RAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                  0);
+  }
+  if (mapped == MAP_FAILED) {
+    perror(path);
+    close(fd);
+    return false;
+  }
+
+  // The mapping keeps the file open
+  close(fd);
+
+  bus->prg_ram = mapped;
+  return true;
+}
+
+void bus_unmap_save(Bus* bus) {
+  if (bus->prg_ram == bus->work_ram) {
+    return;
+  }
+
+  munmap(bus->prg_ram, PRG_RAM_SIZE);
+  bus->prg_ram = bus->work_ram;
+}
+
+// Advances the APU by one CPU cycle
+static void apu_cycle(Bus* bus) {
+  apu_tick(&bus->apu);
+  if (apu_dmc_needs_fetch(&bus->apu)) {
+    apu_dmc_fill(&bus->apu,
+                 cartridge_read(bus, apu_dmc_fetch_addr(&bus->apu)));
+    // The sample fetch steals cycles from the CPU
+    bus->cpu->cycles_remaining += 4;
+  }
+}
+
+void bus_sync(Bus* bus) {
+  Cpu* cpu = bus->cpu;
+  long cycles = cpu->cycles_total - bus->synced_cycle;
+  if (cycles > 0) {
+    // Nothing in between talks to the other, so each runs on its own
+    ppu_run(&bus->ppu, cycles * 3);
+    for (long i = 0; i < cycles; i++) {
+      apu_cycle(bus);
+    }
+    bus->synced_cycle = cpu->cycles_total;
+  }
+
+  if (bus->ppu.nmi) {
+    bus->ppu.nmi = false;
+    cpu->nmi_pending = true;
+  }
+  cpu->irq_line = apu_irq(&bus->apu);
+}
+
+static void schedule_vblank(Bus* bus) {
+  long cycles = (ppu_dots_to_vblank(&bus->ppu) + 2) / 3;
+  scheduler_schedule(&bus->scheduler, EventVblank, bus->synced_cycle + cycles);
+}
+
+static void schedule_or_cancel(Bus* bus, EventKind kind, long cycles) {
+  if (cycles < 0) {
+    scheduler_cancel(&bus->scheduler, kind);
+  } else {
+    scheduler_schedule(&bus->scheduler, kind, bus->synced_cycle + cycles);
+  }
+}
+
+// Register accesses can move both APU events
+static void schedule_apu(Bus* bus) {
+  schedule_or_cancel(bus, EventFrameIrq, apu_cycles_to_frame_irq(&bus->apu));
+  schedule_or_cancel(bus, EventDmc, apu_cycles_to_dmc(&bus->apu));
+}
+
+void bus_run_events(Bus* bus) {
+  bus_sync(bus);
+
+  EventKind kind;
+  while (scheduler_pop(&bus->scheduler, bus->synced_cycle, &kind)) {
+    switch (kind) {
+      case EventVblank:
+        // Predictions around odd frames can be a dot early
+        if (bus->ppu.frame > bus->scheduler.frames) {
+          scheduler_end_frame(&bus->scheduler);
+          if (bus->cheats) {
+            cheats_freeze(bus->cheats, bus);
+          }
+        }
+        schedule_vblank(bus);
+        break;
+      case EventFrameIrq:
+      case EventDmc:
+        schedule_apu(bus);
+        break;
+      default:
+        break;
+    }
+  }
+
+  bus->next_event = scheduler_next(&bus->scheduler);
+}
+
+// After an APU register access
+static void apu_changed(Bus* bus) {
+  bus_sync(bus);
+  schedule_apu(bus);
+  bus->next_event = scheduler_next(&bus->scheduler);
 }
 
-uint8_t cartridge_read(Bus* bus, uint16_t raw_addr) {
-  uint16_t addr = raw_addr;
+static void oam_dma(Bus* bus, uint8_t page);
+
+long cartridge_prg_offset(Bus* bus, uint16_t addr) {
+  if (addr < 0x8000) {
+    return -1;
+  }
+
   switch (bus->mapping_num) {
     case 000:
       addr -= 0x8000;
@@ -20,22 +239,62 @@ uint8_t cartridge_read(Bus* bus, uint16_t raw_addr) {
         // Mirror down 0x4000 if the PRG ROM is smaller
         addr %= 0x4000;
       }
-
-      // Add the header (0x10)
-      return bus->rom[addr + 0x10];
+      return addr;
+    case 31: {
+      long bank_count = bus->rom[4] * 4;
+      uint8_t bank = bus->prg_banks[(addr - 0x8000) >> 12];
+      return (bank % bank_count) * 0x1000 + (addr & 0x0FFF);
+    }
     default:
-      break;
+      return -1;
   }
+}
 
-  return 0;
+uint8_t cartridge_read(Bus* bus, uint16_t addr) {
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    return bus->prg_ram[addr - 0x6000];
+  }
+
+  // Patched pages replace the ROM's wholesale
+  if (bus->cheats && bus->cheats->pages[addr >> 8]) {
+    return bus->cheats->pages[addr >> 8][addr & 0xFF];
+  }
+
+  // Nothing answers in expansion space or unsupported mappers
+  long offset = cartridge_prg_offset(bus, addr);
+  if (offset < 0) {
+    return 0;
+  }
+
+  // Add the header (0x10)
+  return bus->rom[offset + 0x10];
 }
 
-uint8_t mem_read(Bus* bus, uint16_t addr) {
+static uint8_t bus_read(Bus* bus, uint16_t addr) {
   // Mirror internal RAM addresses
   if (addr <= 0x1FFF) {
     return bus->cpu_ram[addr % 0x0800];
   }
 
+  // PPU registers, mirrored every 8 bytes
+  if (addr <= 0x3FFF) {
+    bus_sync(bus);
+    return ppu_read(&bus->ppu, addr);
+  }
+
+  if (addr == 0x4015) {
+    bus_sync(bus);
+    uint8_t status = apu_read_status(&bus->apu);
+    // Acknowledging the frame IRQ lets the next one be scheduled
+    apu_changed(bus);
+    return status;
+  }
+
+  // Controllers
+  if (addr == 0x4016 || addr == 0x4017) {
+    return controller_read(&bus->controllers[addr - 0x4016]);
+  }
+
   // Cartridge space
   if (addr >= 0x4020) {
     return cartridge_read(bus, addr);
@@ -44,6 +303,36 @@ uint8_t mem_read(Bus* bus, uint16_t addr) {
   return 0;
 }
 
+static void cover(Bus* bus, uint16_t addr, CoverageKind kind) {
+  long offset = cartridge_prg_offset(bus, addr);
+  if (offset >= 0) {
+    coverage_mark(bus->coverage, offset, kind);
+  }
+}
+
+static uint8_t read_as(Bus* bus, uint16_t addr, CoverageKind kind) {
+  uint8_t val = bus_read(bus, addr);
+  if (bus->breakpoints) {
+    watchpoint_check(bus->breakpoints, addr, val, WatchRead);
+  }
+  if (bus->stats) {
+    stats_access(bus->stats, addr, false);
+  }
+  if (bus->coverage) {
+    cover(bus, addr, kind);
+  }
+
+  return val;
+}
+
+uint8_t mem_read(Bus* bus, uint16_t addr) {
+  return read_as(bus, addr, CoverageRead);
+}
+
+uint8_t mem_fetch(Bus* bus, uint16_t addr) {
+  return read_as(bus, addr, CoverageOpcode);
+}
+
 uint16_t mem_read_16(Bus* bus, uint16_t addr) {
   uint8_t lo = mem_read(bus, addr);
   uint8_t hi = mem_read(bus, addr + 1);
@@ -51,12 +340,105 @@ uint16_t mem_read_16(Bus* bus, uint16_t addr) {
   return (uint16_t)((hi << 8) | lo);
 }
 
-uint8_t mem_peek(Bus* bus, uint16_t addr) { return mem_read(bus, addr); }
-uint16_t mem_peek_16(Bus* bus, uint16_t addr) { return mem_read_16(bus, addr); }
+// Peeks never have side effects and never trigger watchpoints. Catching the
+// PPU and APU up doesn't count, it only brings forward work due anyway.
+uint8_t mem_peek(Bus* bus, uint16_t addr) {
+  if (addr >= 0x2000 && addr <= 0x3FFF) {
+    bus_sync(bus);
+    return ppu_peek(&bus->ppu, addr);
+  }
+
+  if (addr == 0x4015) {
+    bus_sync(bus);
+    return apu_peek_status(&bus->apu);
+  }
+
+  if (addr == 0x4016 || addr == 0x4017) {
+    return controller_peek(&bus->controllers[addr - 0x4016]);
+  }
+
+  return bus_read(bus, addr);
+}
+
+uint16_t mem_peek_16(Bus* bus, uint16_t addr) {
+  uint8_t lo = mem_peek(bus, addr);
+  uint8_t hi = mem_peek(bus, addr + 1);
+
+  return (uint16_t)((hi << 8) | lo);
+}
 
 void mem_write(Bus* bus, uint16_t addr, uint8_t val) {
+  if (bus->breakpoints) {
+    watchpoint_check(bus->breakpoints, addr, val, WatchWrite);
+  }
+  if (bus->stats) {
+    stats_access(bus->stats, addr, true);
+  }
+
   // Internal RAM
   if (addr <= 0x1FFF) {
     bus->cpu_ram[addr % 0x0800] = val;
+    return;
+  }
+
+  // Register writes happen on an up to date PPU and APU, and may raise an
+  // NMI or move the APU's events
+  if (addr <= 0x3FFF) {
+    bus_sync(bus);
+    ppu_write(&bus->ppu, addr, val);
+    bus_sync(bus);
+    return;
+  }
+
+  if (addr == 0x4014) {
+    bus_sync(bus);
+    oam_dma(bus, val);
+    return;
+  }
+
+  // Strobe both controllers
+  if (addr == 0x4016) {
+    controller_write(&bus->controllers[0], val);
+    controller_write(&bus->controllers[1], val);
+    return;
+  }
+
+  // APU registers, $4017 is the frame counter on writes
+  if (addr <= 0x4017) {
+    bus_sync(bus);
+    apu_write(&bus->apu, addr, val);
+    apu_changed(bus);
+    return;
+  }
+
+  // Mapper 31 bank registers, mirrored so NSF players can use $5FF8-$5FFF
+  if (bus->mapping_num == 31 && addr >= 0x5000 && addr <= 0x5FFF) {
+    bus->prg_banks[addr & 7] = val;
+    return;
+  }
+
+  if (addr >= 0x6000 && addr <= 0x7FFF) {
+    bus->prg_ram[addr - 0x6000] = val;
+  }
+}
+
+static void oam_dma(Bus* bus, uint8_t page) {
+  for (int i = 0; i < 0x100; i++) {
+    ppu_write(&bus->ppu, 0x2004, bus_read(bus, (uint16_t)(page << 8 | i)));
+  }
+
+  // The CPU is halted while the copy happens, one more cycle to align on odd
+  // cycles
+  bus->cpu->cycles_remaining += 513 + (int)(bus->cpu->cycles_total & 1);
+}
+
+// Debugger writes, these never trigger watchpoints
+void mem_poke(Bus* bus, uint16_t addr, uint8_t val) {
+  if (addr <= 0x1FFF) {
+    bus->cpu_ram[addr % 0x0800] = val;
+  } else if (addr >= 0x6000 && addr <= 0x7FFF) {
+    bus->prg_ram[addr - 0x6000] = val;
   }
 }
+
+#endif
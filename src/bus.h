@@ -1,8 +1,17 @@
 #pragma once
+#include "apu.h"
+#include "controller.h"
 #include "cpu.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef struct Cpu Cpu;
+typedef struct Breakpoints Breakpoints;
+typedef struct Stats Stats;
+typedef struct Coverage Coverage;
+typedef struct Cheats Cheats;
 typedef struct Bus {
     unsigned char* rom;
     Cpu* cpu;
@@ -10,15 +19,72 @@ typedef struct Bus {
     int mapping_num;
 
     unsigned char* cpu_ram;
+    // 8K at $6000-$7FFF, a shared mapping of the save file for cartridges
+    // with a battery once bus_map_save succeeds
+    uint8_t* prg_ram;
+    // Plain PRG RAM, set aside while the save file is mapped
+    uint8_t* work_ram;
+    // Mapper 31, the 4K PRG ROM bank at each $1000 from $8000
+    uint8_t prg_banks[8];
+
+    Ppu ppu;
+    Apu apu;
+    Controller controllers[2];
+
+    // Only set while at least one breakpoint/watchpoint is armed
+    Breakpoints* breakpoints;
+    // Only set while collecting statistics or coverage
+    Stats* stats;
+    Coverage* coverage;
+    // Only set while cheats are active
+    Cheats* cheats;
+
+    // The PPU and APU lag behind the CPU and catch up on demand. This is the
+    // CPU cycle they have been run to.
+    long synced_cycle;
+    // When an NMI, IRQ or DMC fetch may be due, next_event is the earliest
+    long next_event;
+    Scheduler scheduler;
 } Bus;
 
+#define CPU_RAM_SIZE 0x0800
+#define PRG_RAM_SIZE 0x2000
+#define CHR_RAM_SIZE 0x2000
+
+// Memory the bus and PPU work in, zeroed, owned by whoever made the bus
+typedef struct BusMemory {
+  uint8_t* cpu_ram;
+  uint8_t* prg_ram;
+  // Only used by cartridges without CHR ROM
+  uint8_t* chr_ram;
+  // PPU_WIDTH * PPU_HEIGHT
+  uint8_t* framebuffer;
+} BusMemory;
+
+// Allocates its memory on the heap
 Bus bus_init(unsigned char* rom);
+Bus bus_init_in(unsigned char* rom, const BusMemory* memory);
+// Backs PRG RAM with the save file at path, creating it if needed. Writes go
+// straight to the page cache, so nothing needs flushing even on a crash.
+// Cartridges without a battery keep plain RAM and succeed.
+bool bus_map_save(Bus* bus, const char* path);
+void bus_unmap_save(Bus* bus);
+
+// Runs the PPU and APU up to the CPU's cycles_total
+void bus_sync(Bus* bus);
+// Catches up and handles every event due by now
+void bus_run_events(Bus* bus);
 
 uint8_t cartridge_read(Bus* bus, uint16_t addr);
+// Offset into PRG ROM of a CPU address as currently mapped, -1 outside ROM
+long cartridge_prg_offset(Bus* bus, uint16_t addr);
 uint8_t mem_read(Bus* bus, uint16_t addr);
+// An opcode fetch, a read that coverage records as an opcode
+uint8_t mem_fetch(Bus* bus, uint16_t addr);
 uint16_t mem_read_16(Bus* bus, uint16_t addr);
 
 uint8_t mem_peek(Bus* bus, uint16_t addr);
 uint16_t mem_peek_16(Bus* bus, uint16_t addr);
 
 void mem_write(Bus* bus, uint16_t addr, uint8_t val);
+void mem_poke(Bus* bus, uint16_t addr, uint8_t val);
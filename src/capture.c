@@ -0,0 +1,332 @@
+#include "capture.h"
+#include "apu.h"
+#include "palette.h"
+#include "wav.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAPTURE_QUEUE_SIZE 8
+#define FRAME_PIXELS (PPU_WIDTH * PPU_HEIGHT)
+
+static const char Y4M_HEADER[] =
+    "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n";
+static const char Y4M_FRAME[] = "FRAME\n";
+
+// Studio swing BT.601
+static void build_yuv_tables(Capture* capture) {
+  for (int i = 0; i < 64; i++) {
+    double r = PALETTE_RGB[i][0];
+    double g = PALETTE_RGB[i][1];
+    double b = PALETTE_RGB[i][2];
+
+    capture->y_table[i] =
+        (uint8_t)(16.5 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0);
+    capture->u_table[i] =
+        (uint8_t)(128.5 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0);
+    capture->v_table[i] =
+        (uint8_t)(128.5 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0);
+  }
+}
+
+static bool write_all(int fd, const void* data, size_t len) {
+  const uint8_t* bytes = data;
+  while (len) {
+    ssize_t written = write(fd, bytes, len);
+    if (written < 0) {
+      return false;
+    }
+
+    bytes += written;
+    len -= (size_t)written;
+  }
+
+  return true;
+}
+
+static bool writev_all(int fd, struct iovec* iov, int count) {
+  while (count) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      return false;
+    }
+
+    // Skip whatever made it out, resume in the middle of a partial buffer
+    size_t left = (size_t)written;
+    while (count && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count) {
+      iov->iov_base = (uint8_t*)iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+
+  return true;
+}
+
+// The three planes of a 4:4:4 frame, one scanline at a time
+static void convert_y4m(Capture* capture, const uint8_t* pixels) {
+  uint8_t* y = capture->video_buffer;
+  uint8_t* u = y + FRAME_PIXELS;
+  uint8_t* v = u + FRAME_PIXELS;
+
+  for (int line = 0; line < FRAME_PIXELS; line += PPU_WIDTH) {
+    const uint8_t* in = pixels + line;
+    for (int x = 0; x < PPU_WIDTH; x++) {
+      uint8_t index = in[x] & 0x3F;
+      y[line + x] = capture->y_table[index];
+      u[line + x] = capture->u_table[index];
+      v[line + x] = capture->v_table[index];
+    }
+  }
+}
+
+static void convert_rgb(Capture* capture, const uint8_t* pixels) {
+  for (int line = 0; line < FRAME_PIXELS; line += PPU_WIDTH) {
+    const uint8_t* in = pixels + line;
+    uint8_t* out = capture->video_buffer + line * 3;
+    for (int x = 0; x < PPU_WIDTH; x++) {
+      memcpy(out + x * 3, PALETTE_RGB[in[x] & 0x3F], 3);
+    }
+  }
+}
+
+static bool write_video(Capture* capture, const FrameSlot* slot) {
+  struct iovec iov[2];
+  int count = 0;
+
+  if (capture->y4m) {
+    convert_y4m(capture, slot->pixels);
+    iov[count++] = (struct iovec){(void*)Y4M_FRAME, sizeof(Y4M_FRAME) - 1};
+  } else {
+    convert_rgb(capture, slot->pixels);
+  }
+  iov[count++] = (struct iovec){capture->video_buffer, FRAME_PIXELS * 3};
+
+  return writev_all(capture->video_fd, iov, count);
+}
+
+// Samples are written in host order, which is what WAV wants on every
+// machine this runs on
+static bool flush_audio(Capture* capture) {
+  bool ok = write_all(capture->audio_fd, capture->audio_buffer,
+                      (size_t)capture->audio_buffered * sizeof(int16_t));
+  capture->audio_samples += capture->audio_buffered;
+  capture->audio_buffered = 0;
+  return ok;
+}
+
+static bool write_audio(Capture* capture, const FrameSlot* slot) {
+  if (capture->audio_buffered + slot->audio_count > CAPTURE_AUDIO_BUFFER &&
+      !flush_audio(capture)) {
+    return false;
+  }
+
+  memcpy(capture->audio_buffer + capture->audio_buffered, slot->audio,
+         (size_t)slot->audio_count * sizeof(int16_t));
+  capture->audio_buffered += slot->audio_count;
+  return true;
+}
+
+static void* capture_thread(void* arg) {
+  Capture* capture = arg;
+  const struct timespec pause = {.tv_nsec = 1000000};
+
+  for (;;) {
+    // Check before looking at the queue so the last frames aren't missed
+    bool stopping = atomic_load(&capture->stop);
+
+    FrameSlot* slot = frame_queue_next(&capture->queue);
+    if (!slot) {
+      if (stopping) {
+        break;
+      }
+      nanosleep(&pause, NULL);
+      continue;
+    }
+
+    if (!capture->failed) {
+      if ((capture->video_fd >= 0 && !write_video(capture, slot)) ||
+          (capture->audio_fd >= 0 && !write_audio(capture, slot))) {
+        perror("capture");
+        capture->failed = true;
+      }
+    }
+
+    capture->frames++;
+    frame_queue_release(&capture->queue);
+  }
+
+  return NULL;
+}
+
+static int open_output(const char* path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+  }
+  return fd;
+}
+
+static bool ends_with(const char* str, const char* suffix) {
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+// The fd is kept even if the header fails, so it gets closed
+static bool open_video(Capture* capture, const char* path) {
+  capture->y4m = ends_with(path, ".y4m");
+  capture->video_fd = open_output(path);
+  if (capture->video_fd < 0) {
+    return false;
+  }
+
+  build_yuv_tables(capture);
+  return !capture->y4m ||
+         write_all(capture->video_fd, Y4M_HEADER, sizeof(Y4M_HEADER) - 1);
+}
+
+static bool open_audio(Capture* capture, const char* path) {
+  capture->audio_fd = open_output(path);
+  if (capture->audio_fd < 0) {
+    return false;
+  }
+
+  uint8_t header[WAV_HEADER_SIZE];
+  wav_header(header, 0);
+  return write_all(capture->audio_fd, header, sizeof(header));
+}
+
+static bool start_pipeline(Capture* capture, Ppu* ppu) {
+  capture->pipeline = malloc(sizeof(PpuPipeline));
+  if (!capture->pipeline || !pipeline_start(capture->pipeline, ppu)) {
+    free(capture->pipeline);
+    capture->pipeline = NULL;
+    return false;
+  }
+  return true;
+}
+
+// Undoes whatever part of capture_start got done, before the writer thread
+// exists
+static void abandon(Capture* capture) {
+  if (capture->pipeline) {
+    pipeline_stop(capture->pipeline);
+    free(capture->pipeline);
+    capture->pipeline = NULL;
+  }
+
+  if (capture->video_fd >= 0) {
+    close(capture->video_fd);
+    capture->video_fd = -1;
+  }
+  if (capture->audio_fd >= 0) {
+    close(capture->audio_fd);
+    capture->audio_fd = -1;
+  }
+
+  free(capture->video_buffer);
+  capture->video_buffer = NULL;
+  frame_queue_free(&capture->queue);
+}
+
+bool capture_start(Capture* capture, const char* video_path,
+                   const char* audio_path, Ppu* ppu) {
+  capture->pipeline = NULL;
+  capture->filling = NULL;
+  capture->drawing = NULL;
+  capture->draw_waited = 0;
+  capture->video_fd = -1;
+  capture->audio_fd = -1;
+  capture->audio_buffered = 0;
+  capture->audio_samples = 0;
+  capture->frames = 0;
+  capture->failed = false;
+  atomic_init(&capture->stop, false);
+
+  // Both files are open before any thread starts, so a failure only has
+  // memory and fds to give back
+  bool ok = frame_queue_init(&capture->queue, CAPTURE_QUEUE_SIZE);
+  capture->video_buffer = malloc(FRAME_PIXELS * 3);
+  ok = ok && capture->video_buffer;
+  ok = ok && (!video_path || open_video(capture, video_path));
+  ok = ok && (!audio_path || open_audio(capture, audio_path));
+  ok = ok && (!video_path || !ppu || start_pipeline(capture, ppu));
+  ok = ok &&
+       pthread_create(&capture->thread, NULL, capture_thread, capture) == 0;
+
+  if (!ok) {
+    abandon(capture);
+  }
+  return ok;
+}
+
+bool capture_stop(Capture* capture) {
+  if (capture->pipeline) {
+    pipeline_stop(capture->pipeline);
+    if (capture->drawing) {
+      frame_queue_publish(&capture->queue);
+    }
+
+    capture->draw_waited = capture->pipeline->waited;
+    free(capture->pipeline);
+    capture->pipeline = NULL;
+  }
+
+  atomic_store(&capture->stop, true);
+  pthread_join(capture->thread, NULL);
+
+  bool ok = !capture->failed;
+
+  if (capture->video_fd >= 0) {
+    ok &= close(capture->video_fd) == 0;
+  }
+
+  if (capture->audio_fd >= 0) {
+    ok &= flush_audio(capture);
+
+    uint8_t header[WAV_HEADER_SIZE];
+    wav_header(header, (uint32_t)(capture->audio_samples * 2));
+    ok &= pwrite(capture->audio_fd, header, sizeof(header), 0) ==
+          (ssize_t)sizeof(header);
+    ok &= close(capture->audio_fd) == 0;
+  }
+
+  free(capture->video_buffer);
+  frame_queue_free(&capture->queue);
+  return ok;
+}
+
+FrameSlot* capture_acquire(Capture* capture) {
+  capture->filling = frame_queue_acquire_wait(&capture->queue);
+  return capture->filling;
+}
+
+void capture_publish(Capture* capture) {
+  if (!capture->pipeline) {
+    frame_queue_publish(&capture->queue);
+    return;
+  }
+
+  // The new frame is drawn while the next one runs. Submitting waits for
+  // the one before, so that one can go to the writer now.
+  pipeline_submit(capture->pipeline, capture->filling->pixels);
+  if (capture->drawing) {
+    frame_queue_publish(&capture->queue);
+  }
+  capture->drawing = capture->filling;
+}
+
+void capture_sync(Capture* capture) {
+  if (capture->pipeline) {
+    pipeline_wait(capture->pipeline);
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "framequeue.h"
+#include "pipeline.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CAPTURE_AUDIO_BUFFER 0x8000
+
+// Writes every emulated frame to disk on a background thread: video as Y4M
+// (or raw RGB24 when the file doesn't end in .y4m) and audio as a 16-bit
+// mono WAV. Unlike presentation no frame is ever dropped, the emulation
+// waits for the writer when the queue is full.
+typedef struct Capture {
+  FrameQueue queue;
+
+  // -1 when not capturing that stream
+  int video_fd;
+  bool y4m;
+  int audio_fd;
+
+  pthread_t thread;
+  atomic_bool stop;
+
+  // Draws video frames off the emulation thread, NULL when the emulation
+  // thread draws them itself
+  PpuPipeline* pipeline;
+  // The slot being filled, and the one before it still being drawn
+  FrameSlot* filling;
+  FrameSlot* drawing;
+  long draw_waited;
+
+  // Writer thread only
+  uint8_t* video_buffer;
+  int16_t audio_buffer[CAPTURE_AUDIO_BUFFER];
+  long audio_buffered;
+  long audio_samples;
+  long frames;
+  bool failed;
+
+  // Palette index to Y4M plane lookups
+  uint8_t y_table[64];
+  uint8_t u_table[64];
+  uint8_t v_table[64];
+} Capture;
+
+// Either path may be NULL. With a video path and a PPU, frames are drawn
+// on a pipeline thread and each slot is published one frame late.
+bool capture_start(Capture* capture, const char* video_path,
+                   const char* audio_path, Ppu* ppu);
+// Returns false if anything failed to write
+bool capture_stop(Capture* capture);
+
+// Producer side, waits for the writer if every slot is full
+FrameSlot* capture_acquire(Capture* capture);
+void capture_publish(Capture* capture);
+// Waits until the pixels of the slot last published are drawn
+void capture_sync(Capture* capture);
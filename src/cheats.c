@@ -0,0 +1,155 @@
+#include "cheats.h"
+#include "bus.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char GAME_GENIE_LETTERS[] = "APZLGITYEOXUKSVN";
+
+// Each letter is 4 bits, scrambled into address, value and compare
+static bool parse_game_genie(const char* code, Cheat* cheat) {
+  size_t len = strlen(code);
+  if (len != 6 && len != 8) {
+    return false;
+  }
+
+  int n[8];
+  for (size_t i = 0; i < len; i++) {
+    // Upper case, a space would become the terminator
+    const char* letter = strchr(GAME_GENIE_LETTERS, code[i] & ~0x20);
+    if (!letter || !*letter) {
+      return false;
+    }
+    n[i] = (int)(letter - GAME_GENIE_LETTERS);
+  }
+
+  *cheat = (Cheat){
+      .kind = CheatRom,
+      .addr = (uint16_t)(0x8000 | (n[3] & 7) << 12 | (n[5] & 7) << 8 |
+                         (n[4] & 8) << 8 | (n[2] & 7) << 4 | (n[1] & 8) << 4 |
+                         (n[4] & 7) | (n[3] & 8)),
+      .value = (uint8_t)((n[1] & 7) << 4 | (n[0] & 8) << 4 | (n[0] & 7)),
+  };
+
+  if (len == 6) {
+    cheat->value |= n[5] & 8;
+  } else {
+    cheat->value |= n[7] & 8;
+    cheat->has_compare = true;
+    cheat->compare = (uint8_t)((n[7] & 7) << 4 | (n[6] & 8) << 4 |
+                               (n[6] & 7) | (n[5] & 8));
+  }
+  return true;
+}
+
+static bool parse_hex(const char* str, char** end, unsigned long max,
+                      unsigned long* out) {
+  *out = strtoul(str, end, 16);
+  return *end != str && *out <= max;
+}
+
+// AAAA:VV or AAAA?CC:VV
+static bool parse_raw(const char* code, Cheat* cheat) {
+  char* end;
+  unsigned long addr, value, compare = 0;
+  if (!parse_hex(code, &end, 0xFFFF, &addr)) {
+    return false;
+  }
+
+  bool has_compare = *end == '?';
+  if (has_compare && !parse_hex(end + 1, &end, 0xFF, &compare)) {
+    return false;
+  }
+
+  if (*end != ':' || !parse_hex(end + 1, &end, 0xFF, &value) || *end) {
+    return false;
+  }
+
+  *cheat = (Cheat){
+      .kind = addr < 0x8000 ? CheatRam : CheatRom,
+      .addr = (uint16_t)addr,
+      .value = (uint8_t)value,
+      .has_compare = has_compare,
+      .compare = (uint8_t)compare,
+  };
+
+  // Only internal RAM can be frozen, and freezes have nothing to compare
+  return cheat->kind == CheatRom || (addr < CPU_RAM_SIZE && !has_compare);
+}
+
+bool cheat_parse(const char* code, Cheat* cheat) {
+  return strchr(code, ':') ? parse_raw(code, cheat)
+                           : parse_game_genie(code, cheat);
+}
+
+bool cheats_add(Cheats* cheats, const Cheat* cheat) {
+  if (cheats->count == CHEATS_MAX) {
+    return false;
+  }
+
+  cheats->cheats[cheats->count++] = *cheat;
+  return true;
+}
+
+static uint8_t* page_copy(Cheats* cheats, Bus* bus, uint8_t page) {
+  if (cheats->pages[page]) {
+    return cheats->pages[page];
+  }
+
+  uint8_t* copy = cheats->copies[cheats->copy_count++];
+  for (int i = 0; i < 0x100; i++) {
+    copy[i] = cartridge_read(bus, (uint16_t)(page << 8 | i));
+  }
+  cheats->pages[page] = copy;
+  return copy;
+}
+
+static bool has_rom_cheats(const Cheats* cheats) {
+  for (int i = 0; i < cheats->count; i++) {
+    if (cheats->cheats[i].kind == CheatRom) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool cheats_attach(Cheats* cheats, Bus* bus) {
+  cheats_detach(bus);
+
+  // Copies are made of the banks mapped now and would shadow whatever gets
+  // switched in later, so only NROM can be patched
+  if (bus->mapping_num != 0 && has_rom_cheats(cheats)) {
+    return false;
+  }
+
+  memset(cheats->pages, 0, sizeof(cheats->pages));
+  cheats->copy_count = 0;
+
+  for (int i = 0; i < cheats->count; i++) {
+    const Cheat* cheat = &cheats->cheats[i];
+    if (cheat->kind != CheatRom) {
+      continue;
+    }
+
+    // Compares are against the ROM itself, not earlier patches
+    uint8_t original = cartridge_read(bus, cheat->addr);
+    uint8_t* copy = page_copy(cheats, bus, (uint8_t)(cheat->addr >> 8));
+    if (!cheat->has_compare || original == cheat->compare) {
+      copy[cheat->addr & 0xFF] = cheat->value;
+    }
+  }
+
+  bus->cheats = cheats;
+  cheats_freeze(cheats, bus);
+  return true;
+}
+
+void cheats_detach(Bus* bus) { bus->cheats = NULL; }
+
+void cheats_freeze(const Cheats* cheats, Bus* bus) {
+  for (int i = 0; i < cheats->count; i++) {
+    const Cheat* cheat = &cheats->cheats[i];
+    if (cheat->kind == CheatRam) {
+      bus->cpu_ram[cheat->addr] = cheat->value;
+    }
+  }
+}
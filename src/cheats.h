@@ -0,0 +1,51 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHEATS_MAX 32
+
+typedef struct Bus Bus;
+
+typedef enum CheatKind {
+  // Reads of a ROM address see value, only if the ROM has compare there
+  // when has_compare is set
+  CheatRom,
+  // RAM at addr is set back to value every frame
+  CheatRam
+} CheatKind;
+
+typedef struct Cheat {
+  CheatKind kind;
+  uint16_t addr;
+  uint8_t value;
+  bool has_compare;
+  uint8_t compare;
+} Cheat;
+
+// Active patches. ROM cheats redirect their pages to patched copies made
+// when the cheats are attached, so cartridge_read only looks at a page
+// table, and only while cheats are attached. RAM freezes are written back
+// once per frame at vblank like a Pro Action Replay hooking NMI, the RAM
+// paths don't check anything.
+typedef struct Cheats {
+  Cheat cheats[CHEATS_MAX];
+  int count;
+
+  // Patched copies by CPU page, NULL where nothing is patched
+  uint8_t* pages[0x100];
+  uint8_t copies[CHEATS_MAX][0x100];
+  int copy_count;
+} Cheats;
+
+// Game Genie codes (6 or 8 letters), or raw AAAA:VV and AAAA?CC:VV with hex
+// digits. Addresses below $0800 are RAM freezes, $8000 and up ROM patches.
+bool cheat_parse(const char* code, Cheat* cheat);
+bool cheats_add(Cheats* cheats, const Cheat* cheat);
+
+// Patches against the ROM and applies the freezes. False, with nothing
+// attached, if there are ROM patches for a cartridge that switches banks.
+bool cheats_attach(Cheats* cheats, Bus* bus);
+void cheats_detach(Bus* bus);
+
+// Called once per frame
+void cheats_freeze(const Cheats* cheats, Bus* bus);
@@ -0,0 +1,32 @@
+#include "controller.h"
+
+void controller_write(Controller* controller, uint8_t val) {
+  controller->strobe = val & 1;
+
+  // While strobe is high the shift register keeps reloading
+  if (controller->strobe) {
+    controller->shift = controller->buttons;
+  }
+}
+
+uint8_t controller_read(Controller* controller) {
+  if (controller->strobe) {
+    controller->shift = controller->buttons;
+  }
+
+  uint8_t bit = controller->shift & 1;
+
+  // Official controllers return 1 once all 8 buttons have been read
+  controller->shift = (uint8_t)((controller->shift >> 1) | 0x80);
+
+  // The upper bits are open bus, usually the high byte of $4016
+  return 0x40 | bit;
+}
+
+uint8_t controller_peek(const Controller* controller) {
+  if (controller->strobe) {
+    return 0x40 | (controller->buttons & 1);
+  }
+
+  return 0x40 | (controller->shift & 1);
+}
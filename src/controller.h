@@ -0,0 +1,27 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bits of the standard controller, in the order they are shifted out
+typedef enum Button {
+  ButtonA = 0x01,
+  ButtonB = 0x02,
+  ButtonSelect = 0x04,
+  ButtonStart = 0x08,
+  ButtonUp = 0x10,
+  ButtonDown = 0x20,
+  ButtonLeft = 0x40,
+  ButtonRight = 0x80
+} Button;
+
+typedef struct Controller {
+  // Currently held buttons, set by the frontend
+  uint8_t buttons;
+
+  uint8_t shift;
+  bool strobe;
+} Controller;
+
+void controller_write(Controller* controller, uint8_t val);
+uint8_t controller_read(Controller* controller);
+uint8_t controller_peek(const Controller* controller);
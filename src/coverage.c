@@ -0,0 +1,99 @@
+#include "coverage.h"
+#include "util.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BANK_SIZE 0x4000
+
+bool coverage_init(Coverage* coverage, const unsigned char* rom) {
+  long prg_size = rom[4] * BANK_SIZE;
+  *coverage = (Coverage){
+      .map = calloc((size_t)(prg_size / 4), 1),
+      .prg_size = prg_size,
+      .prg_hash = hash_fnv1a(FNV_OFFSET_BASIS, rom + 0x10, (size_t)prg_size),
+  };
+  return coverage->map != NULL;
+}
+
+void coverage_free(Coverage* coverage) {
+  free(coverage->map);
+  coverage->map = NULL;
+}
+
+void coverage_mark(Coverage* coverage, long offset, CoverageKind kind) {
+  coverage->map[offset >> 2] |= (uint8_t)(kind << ((offset & 3) * 2));
+}
+
+CoverageKind coverage_get(const Coverage* coverage, long offset) {
+  return (CoverageKind)((coverage->map[offset >> 2] >> ((offset & 3) * 2)) & 3);
+}
+
+bool coverage_merge_file(Coverage* coverage, const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return true;
+  }
+
+  // The map is binary and may start with whitespace bytes, so the header
+  // line is read on its own before scanning it
+  char header[64];
+  long prg_size = 0;
+  uint64_t prg_hash = 0;
+  bool ok = fgets(header, sizeof(header), file) &&
+            sscanf(header, "CNESCOV 1 %ld %" SCNx64, &prg_size, &prg_hash) ==
+                2 &&
+            prg_size == coverage->prg_size && prg_hash == coverage->prg_hash;
+
+  uint8_t chunk[4096];
+  long done = 0;
+  while (ok && done < prg_size / 4) {
+    size_t want = (size_t)(prg_size / 4 - done);
+    if (want > sizeof(chunk)) {
+      want = sizeof(chunk);
+    }
+
+    size_t got = fread(chunk, 1, want, file);
+    for (size_t i = 0; i < got; i++) {
+      coverage->map[done + (long)i] |= chunk[i];
+    }
+    done += (long)got;
+    ok = got == want;
+  }
+
+  fclose(file);
+  return ok;
+}
+
+bool coverage_save(const Coverage* coverage, const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  fprintf(file, "CNESCOV 1 %ld %016" PRIx64 "\n", coverage->prg_size,
+          coverage->prg_hash);
+  fwrite(coverage->map, 1, (size_t)(coverage->prg_size / 4), file);
+
+  bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
+
+void coverage_print(const Coverage* coverage) {
+  long opcodes = 0;
+  long read = 0;
+  long touched = 0;
+  for (long i = 0; i < coverage->prg_size; i++) {
+    CoverageKind kind = coverage_get(coverage, i);
+    opcodes += (kind & CoverageOpcode) != 0;
+    read += (kind & CoverageRead) != 0;
+    touched += kind != 0;
+  }
+
+  printf("Coverage: %ld opcode bytes, %ld operand or data bytes, %ld of %ld "
+         "PRG bytes (%.1f%%)\n",
+         opcodes, read, touched, coverage->prg_size,
+         coverage->prg_size ? 100.0 * (double)touched / (double)coverage->prg_size
+                            : 0.0);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two bits per PRG ROM byte. Operands and data reads share a bit: operands
+// are the read bytes that follow an opcode byte, anything else read is data.
+typedef enum CoverageKind { CoverageOpcode = 1, CoverageRead = 2 } CoverageKind;
+
+// What a run did with each byte of PRG ROM, by ROM offset so bank switching
+// doesn't matter. Maps of one ROM combine with a plain OR, so the runs of a
+// whole test suite can be unioned byte by byte.
+typedef struct Coverage {
+  // Four PRG bytes per map byte, the lowest offset in the low bits
+  uint8_t* map;
+  long prg_size;
+  // Identifies the ROM in saved maps
+  uint64_t prg_hash;
+} Coverage;
+
+bool coverage_init(Coverage* coverage, const unsigned char* rom);
+void coverage_free(Coverage* coverage);
+
+void coverage_mark(Coverage* coverage, long offset, CoverageKind kind);
+CoverageKind coverage_get(const Coverage* coverage, long offset);
+
+// ORs a map saved from the same ROM into this one. A missing file is fine,
+// a map from another ROM is not.
+bool coverage_merge_file(Coverage* coverage, const char* path);
+// A text header line, then the map as is
+bool coverage_save(const Coverage* coverage, const char* path);
+
+// Prints how many bytes were executed and read
+void coverage_print(const Coverage* coverage);
@@ -1,12 +1,65 @@
 #include "cpu.h"
+#include "breakpoint.h"
 #include "bus.h"
 #include "debug.h"
+#include "stats.h"
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 Cpu cpu_init(Bus* bus) {
-  return (Cpu){.bus = bus, .pc = 0xC000, .sp = 0xFD, .status = 0x24};
+  return (Cpu){
+      .bus = bus,
+      .pc = 0xC000,
+      .sp = 0xFD,
+      .status = 0x24,
+      .skip_idle = true,
+#ifdef CNES_CYCLE_ACCURATE
+      .cycle_accurate = true,
+#endif
+  };
+}
+
+// Power-up reset, starts at the reset vector instead of the nestest
+// automation entry point
+void cpu_reset(Cpu* cpu) {
+  cpu->pc = mem_read_16(cpu->bus, 0xFFFC);
+  cpu->sp = 0xFD;
+  cpu->status = 0x24;
+  cpu->cycles_remaining = 7;
+}
+
+// Zero page and the stack can only be internal RAM, so these skip the bus
+// dispatch and the mirroring. Watchpoints and statistics still see them.
+static uint8_t ram_read(Cpu* cpu, uint16_t addr) {
+  uint8_t val = cpu->bus->cpu_ram[addr];
+  if (cpu->bus->breakpoints) {
+    watchpoint_check(cpu->bus->breakpoints, addr, val, WatchRead);
+  }
+  if (cpu->bus->stats) {
+    stats_access(cpu->bus->stats, addr, false);
+  }
+
+  return val;
+}
+
+static void ram_write(Cpu* cpu, uint16_t addr, uint8_t val) {
+  if (cpu->bus->breakpoints) {
+    watchpoint_check(cpu->bus->breakpoints, addr, val, WatchWrite);
+  }
+  if (cpu->bus->stats) {
+    stats_access(cpu->bus->stats, addr, true);
+  }
+
+  cpu->bus->cpu_ram[addr] = val;
+}
+
+// Pointers wrap around within the zero page
+static uint16_t zeropage_pointer(Cpu* cpu, uint8_t addr) {
+  uint8_t lo = ram_read(cpu, addr);
+  uint8_t hi = ram_read(cpu, (uint8_t)(addr + 1));
+  return (uint16_t)((hi << 8) | lo);
 }
 
 static bool pages_differ(uint16_t one, uint16_t two) {
@@ -82,19 +135,16 @@ static uint16_t get_address_indirect(Cpu* cpu) {
 
 static uint16_t get_address_indirect_x(Cpu* cpu) {
   uint8_t base = mem_read(cpu->bus, cpu->pc++) + cpu->x;
-  uint8_t lo = mem_read(cpu->bus, base);
-  uint8_t hi = mem_read(cpu->bus, (uint8_t)(base + 1));
-  return (uint16_t)((hi << 8) | lo);
+  return zeropage_pointer(cpu, base);
 }
 
 static uint16_t get_address_indirect_y(Cpu* cpu) {
   uint8_t base = mem_read(cpu->bus, cpu->pc++);
 
-  uint8_t lo = mem_read(cpu->bus, base);
-  uint8_t hi = mem_read(cpu->bus, (uint8_t)(base + 1));
-  uint16_t final = (uint16_t)(((hi << 8) | lo) + cpu->y);
+  uint16_t pointer = zeropage_pointer(cpu, base);
+  uint16_t final = (uint16_t)(pointer + cpu->y);
 
-  if (pages_differ((uint16_t)((hi << 8) | lo), final)) {
+  if (pages_differ(pointer, final)) {
     cpu->bounds_crossed = true;
   }
 
@@ -150,7 +200,7 @@ static void set_negative_and_zero(Cpu* cpu, uint8_t num) {
 static const int STACK_START = 0x0100;
 
 static void stack_push(Cpu* cpu, uint8_t val) {
-  mem_write(cpu->bus, STACK_START + cpu->sp, val);
+  ram_write(cpu, STACK_START + cpu->sp, val);
   cpu->sp--;
 }
 
@@ -161,7 +211,7 @@ static void stack_push_16(Cpu* cpu, uint16_t val) {
 
 static uint8_t stack_pop(Cpu* cpu) {
   cpu->sp++;
-  return mem_read(cpu->bus, STACK_START + cpu->sp);
+  return ram_read(cpu, STACK_START + cpu->sp);
 }
 
 static uint16_t stack_pop_16(Cpu* cpu) {
@@ -482,16 +532,27 @@ static void atx(Cpu* cpu, uint8_t val) {
   cpu->x = cpu->a;
 }
 
+// The unstable stores AND the value with the high byte of the base address
+// plus one, and that value replaces the high byte when indexing crosses a
+// page. Flags are left alone.
+static void unstable_store(Cpu* cpu, uint16_t addr, uint8_t reg) {
+  uint8_t base_hi = (uint8_t)((addr >> 8) - cpu->bounds_crossed);
+  uint8_t val = reg & (uint8_t)(base_hi + 1);
+  if (cpu->bounds_crossed) {
+    addr = (uint16_t)(val << 8 | (addr & 0xFF));
+  }
+  mem_write(cpu->bus, addr, val);
+}
+
 static void axa(Cpu* cpu, uint16_t addr) {
-  mem_write(cpu->bus, cpu->x & cpu->a & (addr >> 8), (uint8_t)addr);
+  unstable_store(cpu, addr, cpu->a & cpu->x);
 }
 
+// Compares like CMP, without borrowing in
 static void axs(Cpu* cpu, uint8_t val) {
-  cpu->x &= cpu->a;
-  cpu->x -= val;
-  if (cpu->x >= val) {
-    set_flag(&cpu->status, FLAG_STATUS_CARRY, true);
-  }
+  uint8_t result = cpu->a & cpu->x;
+  set_flag(&cpu->status, FLAG_STATUS_CARRY, result >= val);
+  cpu->x = result - val;
   set_negative_and_zero(cpu, cpu->x);
 }
 
@@ -503,17 +564,9 @@ static void lar(Cpu* cpu, uint16_t addr) {
   set_negative_and_zero(cpu, result);
 }
 
-static void sxa(Cpu* cpu, uint16_t addr) {
-  uint8_t result = cpu->x & ((uint8_t)(addr >> 8) + 1);
-  set_negative_and_zero(cpu, result);
-  mem_write(cpu->bus, addr, result);
-}
+static void sxa(Cpu* cpu, uint16_t addr) { unstable_store(cpu, addr, cpu->x); }
 
-static void sya(Cpu* cpu, uint16_t addr) {
-  uint8_t result = cpu->y & ((uint8_t)(addr >> 8) + 1);
-  set_negative_and_zero(cpu, result);
-  mem_write(cpu->bus, addr, result);
-}
+static void sya(Cpu* cpu, uint16_t addr) { unstable_store(cpu, addr, cpu->y); }
 
 static void xaa(Cpu* cpu, uint8_t val) {
   cpu->a = cpu->x;
@@ -523,9 +576,7 @@ static void xaa(Cpu* cpu, uint8_t val) {
 
 static void xas(Cpu* cpu, uint16_t addr) {
   cpu->sp = cpu->x & cpu->a;
-  uint8_t result = cpu->sp & ((uint8_t)(addr >> 8) + 1);
-  mem_write(cpu->bus, addr, result);
-  set_negative_and_zero(cpu, result);
+  unstable_store(cpu, addr, cpu->sp);
 }
 
 static void aac(Cpu* cpu, uint8_t val) {
@@ -534,16 +585,621 @@ static void aac(Cpu* cpu, uint8_t val) {
   set_flag(&cpu->status, FLAG_STATUS_CARRY, cpu->status & FLAG_STATUS_NEGATIVE);
 }
 
+static void interrupt(Cpu* cpu, uint16_t vector) {
+  stack_push_16(cpu, cpu->pc);
+  // B flag is only set when pushed by BRK/PHP
+  stack_push(cpu, (uint8_t)((cpu->status & ~0b00010000) | 0b00100000));
+  sei(cpu);
+  cpu->pc = mem_read_16(cpu->bus, vector);
+  cpu->cycles_remaining += 7;
+}
+
+// Like an IRQ but with B set, the byte after BRK is skipped
+static void brk(Cpu* cpu) {
+  stack_push_16(cpu, cpu->pc + 1);
+  stack_push(cpu, cpu->status | 0b00110000);
+  sei(cpu);
+  cpu->pc = mem_read_16(cpu->bus, 0xFFFE);
+}
+
+// The rest of the system only catches up when an event is due, register
+// accesses catch it up on their own
+static void end_cycle(Cpu* cpu) {
+  if (++cpu->cycles_total >= cpu->bus->next_event) {
+    bus_run_events(cpu->bus);
+  }
+}
+
+// === Cycle accurate core ==
+//
+// Every cycle is one bus access, in the order the 6502 does them, followed
+// by the end of the cycle. Based on the
+// per-cycle breakdown in 6502_cpu.txt.
+
+typedef enum Access { AccessRead, AccessWrite, AccessModify } Access;
+
+static void log_access(Cpu* cpu, uint16_t addr, uint8_t val, bool write) {
+  cpu->access_log[cpu->access_count % cpu->access_log_size] = (BusAccess){
+      .cycle = cpu->cycles_total, .addr = addr, .val = val, .write = write};
+  cpu->access_count++;
+}
+
+static uint8_t cycle_read(Cpu* cpu, uint16_t addr) {
+  uint8_t val = mem_read(cpu->bus, addr);
+  if (cpu->access_log) {
+    log_access(cpu, addr, val, false);
+  }
+  end_cycle(cpu);
+  return val;
+}
+
+static uint8_t cycle_fetch(Cpu* cpu) {
+  uint16_t addr = cpu->pc++;
+  uint8_t val = mem_fetch(cpu->bus, addr);
+  if (cpu->access_log) {
+    log_access(cpu, addr, val, false);
+  }
+  end_cycle(cpu);
+  return val;
+}
+
+static void cycle_write(Cpu* cpu, uint16_t addr, uint8_t val) {
+  mem_write(cpu->bus, addr, val);
+  if (cpu->access_log) {
+    log_access(cpu, addr, val, true);
+  }
+  end_cycle(cpu);
+}
+
+static void cycle_push(Cpu* cpu, uint8_t val) {
+  cycle_write(cpu, STACK_START + cpu->sp--, val);
+}
+
+static uint8_t cycle_pull(Cpu* cpu) {
+  return cycle_read(cpu, STACK_START + ++cpu->sp);
+}
+
+static Access access_kind(InstructionName name) {
+  switch (name) {
+    case NameSTA:
+    case NameSTX:
+    case NameSTY:
+    case NameXSAX:
+    case NameXAXA:
+    case NameXSXA:
+    case NameXSYA:
+    case NameXXAS:
+      return AccessWrite;
+    case NameASL:
+    case NameLSR:
+    case NameROL:
+    case NameROR:
+    case NameINC:
+    case NameDEC:
+    case NameXDCP:
+    case NameXISB:
+    case NameXSLO:
+    case NameXRLA:
+    case NameXRRA:
+    case NameXSRE:
+      return AccessModify;
+    default:
+      return AccessRead;
+  }
+}
+
+// Adds an index to a 16-bit base. Reads only take the extra cycle when the
+// page is crossed, writes always do. Either way the first read goes to the
+// address before the carry into the high byte.
+static uint16_t cycle_index(Cpu* cpu, uint16_t base, uint8_t index,
+                            Access access) {
+  uint16_t final = (uint16_t)(base + index);
+  if (access != AccessRead || pages_differ(base, final)) {
+    cycle_read(cpu, (base & 0xFF00) | (final & 0x00FF));
+  }
+  return final;
+}
+
+static uint16_t cycle_address(Cpu* cpu, AddressingMode mode, Access access,
+                              uint16_t* base) {
+  switch (mode) {
+    case ZeroPage:
+      return cycle_read(cpu, cpu->pc++);
+    case ZeroPageX:
+    case ZeroPageY: {
+      uint8_t addr = cycle_read(cpu, cpu->pc++);
+      cycle_read(cpu, addr);
+      return (uint8_t)(addr + (mode == ZeroPageX ? cpu->x : cpu->y));
+    }
+    case Absolute:
+    case AbsoluteX:
+    case AbsoluteY: {
+      uint8_t lo = cycle_read(cpu, cpu->pc++);
+      uint8_t hi = cycle_read(cpu, cpu->pc++);
+      *base = (uint16_t)(hi << 8 | lo);
+      if (mode == Absolute) {
+        return *base;
+      }
+      return cycle_index(cpu, *base, mode == AbsoluteX ? cpu->x : cpu->y,
+                         access);
+    }
+    case IndirectX: {
+      uint8_t ptr = cycle_read(cpu, cpu->pc++);
+      cycle_read(cpu, ptr);
+      ptr += cpu->x;
+      uint8_t lo = cycle_read(cpu, ptr);
+      uint8_t hi = cycle_read(cpu, (uint8_t)(ptr + 1));
+      return (uint16_t)(hi << 8 | lo);
+    }
+    case IndirectY: {
+      uint8_t ptr = cycle_read(cpu, cpu->pc++);
+      uint8_t lo = cycle_read(cpu, ptr);
+      uint8_t hi = cycle_read(cpu, (uint8_t)(ptr + 1));
+      *base = (uint16_t)(hi << 8 | lo);
+      return cycle_index(cpu, *base, cpu->y, access);
+    }
+    default:
+      return 0;
+  }
+}
+
+static void cycle_read_op(Cpu* cpu, InstructionName name, uint8_t val) {
+  switch (name) {
+    case NameADC:
+      adc(cpu, val);
+      break;
+    case NameAND:
+      and(cpu, val);
+      break;
+    case NameBIT:
+      bit(cpu, val);
+      break;
+    case NameCMP:
+      compare(cpu, cpu->a, val);
+      break;
+    case NameCPX:
+      compare(cpu, cpu->x, val);
+      break;
+    case NameCPY:
+      compare(cpu, cpu->y, val);
+      break;
+    case NameEOR:
+      eor(cpu, val);
+      break;
+    case NameLDA:
+      lda(cpu, val);
+      break;
+    case NameLDX:
+      ldx(cpu, val);
+      break;
+    case NameLDY:
+      ldy(cpu, val);
+      break;
+    case NameORA:
+      ora(cpu, val);
+      break;
+    case NameSBC:
+    case NameXSBC:
+      sbc(cpu, val);
+      break;
+    case NameXLAX:
+      lax(cpu, val);
+      break;
+    case NameXAAC:
+      aac(cpu, val);
+      break;
+    case NameXARR:
+      arr(cpu, val);
+      break;
+    case NameXASR:
+      asr(cpu, val);
+      break;
+    case NameXATX:
+      atx(cpu, val);
+      break;
+    case NameXAXS:
+      axs(cpu, val);
+      break;
+    case NameXXAA:
+      xaa(cpu, val);
+      break;
+    case NameXLAR:
+      cpu->sp &= val;
+      cpu->a = cpu->sp;
+      cpu->x = cpu->sp;
+      set_negative_and_zero(cpu, cpu->sp);
+      break;
+    default:
+      // DOP, TOP and NOP only read
+      break;
+  }
+}
+
+static uint8_t cycle_modify_op(Cpu* cpu, InstructionName name, uint8_t val) {
+  uint8_t carry = cpu->status & FLAG_STATUS_CARRY;
+
+  switch (name) {
+    case NameASL:
+    case NameXSLO:
+      set_flag(&cpu->status, FLAG_STATUS_CARRY, val & 0x80);
+      val = (uint8_t)(val << 1);
+      break;
+    case NameLSR:
+    case NameXSRE:
+      set_flag(&cpu->status, FLAG_STATUS_CARRY, val & 1);
+      val >>= 1;
+      break;
+    case NameROL:
+    case NameXRLA:
+      set_flag(&cpu->status, FLAG_STATUS_CARRY, val & 0x80);
+      val = (uint8_t)(val << 1 | carry);
+      break;
+    case NameROR:
+    case NameXRRA:
+      set_flag(&cpu->status, FLAG_STATUS_CARRY, val & 1);
+      val = (uint8_t)(val >> 1 | carry << 7);
+      break;
+    case NameINC:
+    case NameXISB:
+      val++;
+      break;
+    case NameDEC:
+    case NameXDCP:
+      val--;
+      break;
+    default:
+      break;
+  }
+  set_negative_and_zero(cpu, val);
+
+  // The unofficial ones then use the result like a read instruction
+  switch (name) {
+    case NameXSLO:
+      ora(cpu, val);
+      break;
+    case NameXSRE:
+      eor(cpu, val);
+      break;
+    case NameXRLA:
+      and(cpu, val);
+      break;
+    case NameXRRA:
+      adc(cpu, val);
+      break;
+    case NameXISB:
+      sbc(cpu, val);
+      break;
+    case NameXDCP:
+      compare(cpu, cpu->a, val);
+      break;
+    default:
+      break;
+  }
+
+  return val;
+}
+
+// The unstable stores AND the value with the high byte of the base address
+// plus one, and that value replaces the high byte when indexing crosses a
+// page
+static void cycle_store(Cpu* cpu, InstructionName name, uint16_t addr,
+                        uint16_t base) {
+  uint8_t val;
+  switch (name) {
+    case NameSTA:
+      val = cpu->a;
+      break;
+    case NameSTX:
+      val = cpu->x;
+      break;
+    case NameSTY:
+      val = cpu->y;
+      break;
+    case NameXSAX:
+      val = cpu->a & cpu->x;
+      break;
+    default: {
+      // *XAS also loads SP with A & X and stores that
+      uint8_t reg = cpu->a & cpu->x;
+      if (name == NameXSXA) {
+        reg = cpu->x;
+      } else if (name == NameXSYA) {
+        reg = cpu->y;
+      } else if (name == NameXXAS) {
+        cpu->sp = reg;
+      }
+      val = reg & (uint8_t)((base >> 8) + 1);
+      if (pages_differ(base, addr)) {
+        addr = (uint16_t)(val << 8 | (addr & 0xFF));
+      }
+      break;
+    }
+  }
+
+  cycle_write(cpu, addr, val);
+}
+
+static void cycle_implied_op(Cpu* cpu, InstructionName name) {
+  switch (name) {
+    case NameCLC:
+      set_flag(&cpu->status, FLAG_STATUS_CARRY, false);
+      break;
+    case NameCLD:
+      set_flag(&cpu->status, FLAG_STATUS_DECIMAL, false);
+      break;
+    case NameCLI:
+      set_flag(&cpu->status, FLAG_STATUS_INTERRUPT_DISABLE, false);
+      break;
+    case NameCLV:
+      set_flag(&cpu->status, FLAG_STATUS_OVERFLOW, false);
+      break;
+    case NameSEC:
+      sec(cpu);
+      break;
+    case NameSED:
+      sed(cpu);
+      break;
+    case NameSEI:
+      sei(cpu);
+      break;
+    case NameDEX:
+      dex(cpu);
+      break;
+    case NameDEY:
+      dey(cpu);
+      break;
+    case NameINX:
+      inx(cpu);
+      break;
+    case NameINY:
+      iny(cpu);
+      break;
+    case NameTAX:
+      tax(cpu);
+      break;
+    case NameTAY:
+      tay(cpu);
+      break;
+    case NameTSX:
+      tsx(cpu);
+      break;
+    case NameTXA:
+      txa(cpu);
+      break;
+    case NameTXS:
+      txs(cpu);
+      break;
+    case NameTYA:
+      tya(cpu);
+      break;
+    default:
+      // NOP, and KIL which should really hang
+      break;
+  }
+}
+
+static bool branch_taken(Cpu* cpu, InstructionName name) {
+  switch (name) {
+    case NameBCC:
+      return !(cpu->status & FLAG_STATUS_CARRY);
+    case NameBCS:
+      return cpu->status & FLAG_STATUS_CARRY;
+    case NameBNE:
+      return !(cpu->status & FLAG_STATUS_ZERO);
+    case NameBEQ:
+      return cpu->status & FLAG_STATUS_ZERO;
+    case NameBPL:
+      return !(cpu->status & FLAG_STATUS_NEGATIVE);
+    case NameBMI:
+      return cpu->status & FLAG_STATUS_NEGATIVE;
+    case NameBVC:
+      return !(cpu->status & FLAG_STATUS_OVERFLOW);
+    default:
+      return cpu->status & FLAG_STATUS_OVERFLOW;
+  }
+}
+
+static void cycle_branch(Cpu* cpu, InstructionName name) {
+  int8_t offset = (int8_t)cycle_read(cpu, cpu->pc++);
+  if (!branch_taken(cpu, name)) {
+    return;
+  }
+
+  cycle_read(cpu, cpu->pc);
+  uint16_t target = (uint16_t)(cpu->pc + offset);
+  if (pages_differ(cpu->pc, target)) {
+    cycle_read(cpu, (cpu->pc & 0xFF00) | (target & 0x00FF));
+  }
+  cpu->pc = target;
+}
+
+// NMI, IRQ and BRK. BRK has already fetched its padding byte.
+static void cycle_interrupt(Cpu* cpu, uint16_t vector, bool brk) {
+  if (!brk) {
+    cycle_read(cpu, cpu->pc);
+    cycle_read(cpu, cpu->pc);
+  }
+
+  cycle_push(cpu, cpu->pc >> 8);
+  cycle_push(cpu, cpu->pc & 0xFF);
+  cycle_push(cpu, brk ? cpu->status | 0b00110000
+                      : (uint8_t)((cpu->status & ~0b00010000) | 0b00100000));
+  sei(cpu);
+
+  uint8_t lo = cycle_read(cpu, vector);
+  uint8_t hi = cycle_read(cpu, vector + 1);
+  cpu->pc = (uint16_t)(hi << 8 | lo);
+}
+
+// Instructions that don't fit the addressing mode patterns. Returns false
+// if name isn't one of them.
+static bool cycle_control(Cpu* cpu, InstructionName name,
+                          AddressingMode mode) {
+  switch (name) {
+    case NameBRK:
+      cycle_read(cpu, cpu->pc++);
+      cycle_interrupt(cpu, 0xFFFE, true);
+      return true;
+    case NameJMP: {
+      uint8_t lo = cycle_read(cpu, cpu->pc++);
+      uint8_t hi = cycle_read(cpu, cpu->pc++);
+      uint16_t addr = (uint16_t)(hi << 8 | lo);
+      if (mode == Indirect) {
+        // The pointer's high byte never carries into the next page
+        lo = cycle_read(cpu, addr);
+        hi = cycle_read(cpu, (addr & 0xFF00) | ((addr + 1) & 0x00FF));
+        addr = (uint16_t)(hi << 8 | lo);
+      }
+      cpu->pc = addr;
+      return true;
+    }
+    case NameJSR: {
+      uint8_t lo = cycle_read(cpu, cpu->pc++);
+      cycle_read(cpu, STACK_START + cpu->sp);
+      cycle_push(cpu, cpu->pc >> 8);
+      cycle_push(cpu, cpu->pc & 0xFF);
+      uint8_t hi = cycle_read(cpu, cpu->pc);
+      cpu->pc = (uint16_t)(hi << 8 | lo);
+      return true;
+    }
+    case NameRTS: {
+      cycle_read(cpu, cpu->pc);
+      cycle_read(cpu, STACK_START + cpu->sp);
+      uint8_t lo = cycle_pull(cpu);
+      uint8_t hi = cycle_pull(cpu);
+      cpu->pc = (uint16_t)(hi << 8 | lo);
+      cycle_read(cpu, cpu->pc++);
+      return true;
+    }
+    case NameRTI: {
+      cycle_read(cpu, cpu->pc);
+      cycle_read(cpu, STACK_START + cpu->sp);
+      cpu->status = (cpu->status & ~0xCF) | (cycle_pull(cpu) & 0xCF);
+      uint8_t lo = cycle_pull(cpu);
+      uint8_t hi = cycle_pull(cpu);
+      cpu->pc = (uint16_t)(hi << 8 | lo);
+      return true;
+    }
+    case NamePHA:
+    case NamePHP:
+      cycle_read(cpu, cpu->pc);
+      cycle_push(cpu, name == NamePHA ? cpu->a : cpu->status | 0b00110000);
+      return true;
+    case NamePLA:
+    case NamePLP: {
+      cycle_read(cpu, cpu->pc);
+      cycle_read(cpu, STACK_START + cpu->sp);
+      uint8_t val = cycle_pull(cpu);
+      if (name == NamePLA) {
+        lda(cpu, val);
+      } else {
+        cpu->status = (cpu->status & ~0xCF) | (val & 0xCF);
+      }
+      return true;
+    }
+    default:
+      if (mode == Relative) {
+        cycle_branch(cpu, name);
+        return true;
+      }
+      return false;
+  }
+}
+
+static void execute_cycles(Cpu* cpu) {
+  uint8_t opcode = cycle_fetch(cpu);
+  if (cpu->bus->stats) {
+    stats_instruction(cpu->bus->stats, opcode);
+  }
+  InstructionName name = (InstructionName)OPCODES[opcode][0];
+  AddressingMode mode = (AddressingMode)OPCODES[opcode][2];
+
+  if (cycle_control(cpu, name, mode)) {
+    return;
+  }
+
+  if (mode == Implied || mode == Accumulator) {
+    cycle_read(cpu, cpu->pc);
+    if (mode == Accumulator) {
+      cpu->a = cycle_modify_op(cpu, name, cpu->a);
+    } else {
+      cycle_implied_op(cpu, name);
+    }
+    return;
+  }
+
+  if (mode == Immediate) {
+    cycle_read_op(cpu, name, cycle_read(cpu, cpu->pc++));
+    return;
+  }
+
+  Access access = access_kind(name);
+  uint16_t base = 0;
+  uint16_t addr = cycle_address(cpu, mode, access, &base);
+
+  switch (access) {
+    case AccessRead:
+      cycle_read_op(cpu, name, cycle_read(cpu, addr));
+      break;
+    case AccessWrite:
+      cycle_store(cpu, name, addr, base);
+      break;
+    case AccessModify: {
+      // The unmodified value is written back first
+      uint8_t val = cycle_read(cpu, addr);
+      cycle_write(cpu, addr, val);
+      cycle_write(cpu, addr, cycle_modify_op(cpu, name, val));
+      break;
+    }
+  }
+}
+
+// Interrupts take 7 cycles
+static void service_interrupt(Cpu* cpu, uint16_t vector) {
+  if (cpu->cycle_accurate) {
+    cycle_interrupt(cpu, vector, false);
+    return;
+  }
+
+  interrupt(cpu, vector);
+  cpu->cycles_remaining--;
+  end_cycle(cpu);
+}
+
 void cpu_execute(Cpu* cpu) {
   // If we're waiting for cycles to pass,
   // let them pass and don't run any more codef
   if (cpu->cycles_remaining) {
-    cpu->cycles_total++; // These do count as cycles
     cpu->cycles_remaining--;
+    end_cycle(cpu); // These do count as cycles
+    return;
+  }
+
+  // Stop before executing if a breakpoint is hit
+  if (cpu->bus->breakpoints && breakpoint_check(cpu->bus->breakpoints, cpu)) {
+    return;
+  }
+
+  if (cpu->nmi_pending) {
+    cpu->nmi_pending = false;
+    service_interrupt(cpu, 0xFFFA);
+    return;
+  }
+
+  if (cpu->irq_line && !(cpu->status & FLAG_STATUS_INTERRUPT_DISABLE)) {
+    service_interrupt(cpu, 0xFFFE);
     return;
   }
 
-  print_debug(cpu);
+  if (cpu->trace) {
+    print_debug(cpu);
+  }
+
+  cpu->instructions++;
+  if (cpu->cycle_accurate) {
+    execute_cycles(cpu);
+    return;
+  }
 
   cpu->bounds_crossed = false;
 
@@ -551,7 +1207,10 @@ void cpu_execute(Cpu* cpu) {
   Bus* bus = cpu->bus;
 
   // Read the next opcode
-  uint8_t opcode = mem_read(bus, cpu->pc++);
+  uint8_t opcode = mem_fetch(bus, cpu->pc++);
+  if (bus->stats) {
+    stats_instruction(bus->stats, opcode);
+  }
 
   // Fetch opcode info
   uint8_t cycles_num = (uint8_t)OPCODES[opcode][3];
@@ -564,6 +1223,10 @@ void cpu_execute(Cpu* cpu) {
   cpu->cycles_remaining += cycles_num;
 
   switch (opcode) {
+    // BRK
+    case 0x00:
+      brk(cpu);
+      break;
     // ADC
     case 0x69:
     case 0x65:
@@ -684,6 +1347,10 @@ void cpu_execute(Cpu* cpu) {
     case 0xD8:
       set_flag(&cpu->status, FLAG_STATUS_DECIMAL, false);
       break;
+    // CLI
+    case 0x58:
+      set_flag(&cpu->status, FLAG_STATUS_INTERRUPT_DISABLE, false);
+      break;
     // CLV
     case 0xB8:
       set_flag(&cpu->status, FLAG_STATUS_OVERFLOW, false);
@@ -1037,15 +1704,15 @@ void cpu_execute(Cpu* cpu) {
       break;
     // LAR
     case 0xBB:
-      lar(cpu, mem_read(bus, addr));
+      lar(cpu, addr);
       break;
     // SXA
     case 0x9E:
-      sxa(cpu, mem_read(bus, addr));
+      sxa(cpu, addr);
       break;
     // SYA
     case 0x9C:
-      sya(cpu, mem_read(bus, addr));
+      sya(cpu, addr);
       break;
     // XAA
     case 0x8B:
@@ -1053,7 +1720,7 @@ void cpu_execute(Cpu* cpu) {
       break;
     // XAS
     case 0x9B:
-      xas(cpu, mem_read(bus, addr));
+      xas(cpu, addr);
       break;
     // AAC
     case 0x0B:
@@ -1072,5 +1739,228 @@ void cpu_execute(Cpu* cpu) {
   // By getting to here we've already completed
   // one cycle, so let's get rid of it
   cpu->cycles_remaining--;
-  cpu->cycles_total++;
+  end_cycle(cpu);
+}
+
+// === Idle loops ==
+//
+// A loop that only reads memory nothing but an interrupt can change, and
+// comes back to its jump with the registers unchanged, will go around the
+// same way until the next event. Whole iterations up to it are skipped by
+// adding their cycles, which gives the same result as running them.
+
+typedef enum IdleRead {
+  IdleReadMemory,
+  IdleReadPpuStatus,
+  IdleReadOther
+} IdleRead;
+
+static IdleRead idle_read(uint16_t addr) {
+  if (addr < 0x2000 || addr >= 0x6000) {
+    return IdleReadMemory;
+  }
+  if (addr < 0x4000 && (addr & 7) == 2) {
+    return IdleReadPpuStatus;
+  }
+  return IdleReadOther;
+}
+
+static bool idle_instruction(InstructionName name, AddressingMode mode) {
+  switch (name) {
+    case NameADC:
+    case NameAND:
+    case NameBIT:
+    case NameCMP:
+    case NameCPX:
+    case NameCPY:
+    case NameEOR:
+    case NameLDA:
+    case NameLDX:
+    case NameLDY:
+    case NameORA:
+    case NameSBC:
+    case NameCLC:
+    case NameCLD:
+    case NameCLV:
+    case NameSEC:
+    case NameSED:
+    case NameDEX:
+    case NameDEY:
+    case NameINX:
+    case NameINY:
+    case NameNOP:
+    case NameTAX:
+    case NameTAY:
+    case NameTSX:
+    case NameTXA:
+    case NameTYA:
+      return mode != Indirect && mode != IndirectX && mode != IndirectY;
+    case NameASL:
+    case NameLSR:
+    case NameROL:
+    case NameROR:
+      return mode == Accumulator;
+    default:
+      return mode == Relative;
+  }
+}
+
+// Whether the code from start to the jump at end only reads, and only
+// branches within itself or out to right after the jump
+static bool idle_body(Cpu* cpu, uint16_t start, uint16_t end,
+                      bool* reads_ppu) {
+  Bus* bus = cpu->bus;
+  long exit = end + OPCODES[mem_peek(bus, end)][1];
+  *reads_ppu = false;
+
+  for (long pc = start; pc <= end;) {
+    uint8_t opcode = mem_peek(bus, (uint16_t)pc);
+    InstructionName name = (InstructionName)OPCODES[opcode][0];
+    AddressingMode mode = (AddressingMode)OPCODES[opcode][2];
+    uint16_t operand = mem_peek_16(bus, (uint16_t)(pc + 1));
+    pc += OPCODES[opcode][1];
+
+    if (name == NameJMP && mode == Absolute && pc > end) {
+      break;
+    }
+    if (!idle_instruction(name, mode)) {
+      return false;
+    }
+
+    if (mode == Relative) {
+      long target = (uint16_t)(pc + (int8_t)operand);
+      if (target < start || target > exit) {
+        return false;
+      }
+    } else if (mode == Absolute) {
+      IdleRead read = idle_read(operand);
+      if (read == IdleReadOther) {
+        return false;
+      }
+      *reads_ppu |= read == IdleReadPpuStatus;
+    } else if (mode == AbsoluteX || mode == AbsoluteY) {
+      for (int i = 0; i < 0x100; i++) {
+        if (idle_read((uint16_t)(operand + i)) != IdleReadMemory) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+// Target of a taken branch or JMP at pc, -1 for anything else
+static long jump_target(Cpu* cpu, uint16_t pc) {
+  uint8_t opcode = mem_peek(cpu->bus, pc);
+  AddressingMode mode = (AddressingMode)OPCODES[opcode][2];
+
+  if (mode == Relative) {
+    return (uint16_t)(pc + 2 + (int8_t)mem_peek(cpu->bus, (uint16_t)(pc + 1)));
+  }
+  if (OPCODES[opcode][0] == NameJMP && mode == Absolute) {
+    return mem_peek_16(cpu->bus, (uint16_t)(pc + 1));
+  }
+  return -1;
+}
+
+// Called after the instruction at jump_pc jumped backwards, skips up to
+// but not reaching until
+static void skip_idle_loop(Cpu* cpu, uint16_t jump_pc, long until) {
+  IdleLoop* idle = &cpu->idle;
+  Bus* bus = cpu->bus;
+
+  // Interrupts can land below the instruction too
+  if (jump_target(cpu, jump_pc) != cpu->pc) {
+    idle->jump_pc = 0;
+    return;
+  }
+
+  uint8_t regs[5] = {cpu->a, cpu->x, cpu->y, cpu->status, cpu->sp};
+  if (idle->jump_pc != jump_pc || memcmp(idle->regs, regs, 5)) {
+    *idle = (IdleLoop){.jump_pc = jump_pc, .cycle = cpu->cycles_total};
+    memcpy(idle->regs, regs, 5);
+    return;
+  }
+
+  // A DMC stall or an interrupt makes one iteration longer, two in a row
+  // taking as long means neither happened
+  long period = cpu->cycles_total - idle->cycle;
+  bool steady = period == idle->period;
+  idle->period = period;
+  idle->cycle = cpu->cycles_total;
+
+  // Interrupts are due before the next instruction
+  bool irq = cpu->irq_line && !(cpu->status & FLAG_STATUS_INTERRUPT_DISABLE);
+  if (!steady || cpu->nmi_pending || irq) {
+    return;
+  }
+
+  // Code in RAM may have been rewritten by an interrupt since
+  if (!idle->checked || jump_pc < 0x8000) {
+    idle->eligible = idle_body(cpu, cpu->pc, jump_pc, &idle->reads_ppu);
+    idle->checked = true;
+  }
+  if (!idle->eligible) {
+    return;
+  }
+
+  long limit = (bus->next_event < until ? bus->next_event : until) - 1;
+  if (idle->reads_ppu) {
+    // $2002 may have changed after the loop last read it, so it has to
+    // read the same as one iteration ago, and stay that way
+    bus_sync(bus);
+    uint8_t status = bus->ppu.status & 0xE0;
+    bool same = idle->status_known && status == idle->ppu_status;
+    idle->ppu_status = status;
+    idle->status_known = true;
+    if (!same) {
+      return;
+    }
+
+    long stable =
+        cpu->cycles_total + ppu_dots_to_status_change(&bus->ppu) / 3;
+    if (stable < limit) {
+      limit = stable;
+    }
+  }
+
+  // Land before the event so it happens on the right instruction
+  long iterations = (limit - cpu->cycles_total) / period;
+  if (iterations > 0) {
+    cpu->cycles_total += iterations * period;
+    cpu->idle_cycles += iterations * period;
+    idle->cycle = cpu->cycles_total;
+  }
+}
+
+void cpu_run(Cpu* cpu, long until) {
+  while (cpu->cycles_total < until) {
+    uint16_t pc = cpu->pc;
+    cpu_execute(cpu);
+
+    // Breakpoints get to look at every cycle, and a stopped CPU burns none
+    if (cpu->bus->breakpoints) {
+      if (cpu->bus->breakpoints->stopped) {
+        return;
+      }
+      continue;
+    }
+
+    // The cycles an instruction has left go by at once. An NMI raised in
+    // between is only looked at once they are over anyway.
+    if (cpu->cycles_remaining > 0) {
+      cpu->cycles_total += cpu->cycles_remaining;
+      cpu->cycles_remaining = 0;
+      if (cpu->cycles_total >= cpu->bus->next_event) {
+        bus_run_events(cpu->bus);
+      }
+    }
+
+    // Logged and counted accesses have to actually happen
+    if (cpu->pc <= pc && cpu->skip_idle && !cpu->access_log &&
+        !cpu->bus->stats) {
+      skip_idle_loop(cpu, pc, until);
+    }
+  }
 }
@@ -29,6 +29,15 @@ static const char* OPCODES_NAMES[0x50] = {
 /*0x4_*/ "*DOP","*ISB","*KIL","*LAR","*LAX","*NOP","*RLA","*RRA","*SBC","*SLO","*SRE","*SXA","*SYA","*TOP","*XAA","*XAS"
 };
 
+// Indices into OPCODES_NAMES, unofficial opcodes are prefixed with X
+typedef enum InstructionName {
+  NameADC, NameAND, NameASL, NameBCC, NameBCS, NameBEQ, NameBIT, NameBMI, NameBNE, NameBPL, NameBRK, NameBVC, NameBVS, NameCLC, NameCLD, NameCLI,
+  NameCLV, NameCMP, NameCPX, NameCPY, NameDEC, NameDEX, NameDEY, NameEOR, NameINC, NameINX, NameINY, NameJMP, NameJSR, NameLDA, NameLDX, NameLDY,
+  NameLSR, NameNOP, NameORA, NamePHA, NamePHP, NamePLA, NamePLP, NameROL, NameROR, NameRTI, NameRTS, NameSBC, NameSEC, NameSED, NameSEI, NameSTA,
+  NameSTX, NameSTY, NameTAX, NameTAY, NameTSX, NameTXA, NameTXS, NameTYA, NameXAAC,NameXSAX,NameXARR,NameXASR,NameXATX,NameXAXA,NameXAXS,NameXDCP,
+  NameXDOP,NameXISB,NameXKIL,NameXLAR,NameXLAX,NameXNOP,NameXRLA,NameXRRA,NameXSBC,NameXSLO,NameXSRE,NameXSXA,NameXSYA,NameXTOP,NameXXAA,NameXXAS
+} InstructionName;
+
 // Mapping of {name index, length, addressing mode, cycle count, page breaking}
 static const int OPCODES[0x100][5] = {
 /*                 0                         1                  2                        3                  4                         5                     6                         7                   8                    9                       A                            B                    C                       D                   E                        F */
@@ -41,7 +50,7 @@ static const int OPCODES[0x100][5] = {
 /*0x6_*/ {0x2A,1,Implied,6,0},  {0x00,2,IndirectX,6,0},{0x42,1,Implied,0,0},  {0x47,2,IndirectX,8,0},{0x45,2,ZeroPage,3,0}, {0x00,2,ZeroPage,3,0}, {0x28,2,ZeroPage,5,0}, {0x47,2,ZeroPage,5,0}, {0x25,1,Implied,4,0},{0x00,2,Immediate,2,0},{0x28,1,Accumulator,2,0},{0x3A,2,Immediate,2,0},{0x1B,3,Indirect,5,0}, {0x00,3,Absolute,4,0}, {0x28,3,Absolute,6,0}, {0x47,3,Absolute,6,0},
 /*0x7_*/ {0x0C,2,Relative,2,1}, {0x00,2,IndirectY,5,1},{0x42,1,Implied,0,0},  {0x47,2,IndirectY,8,0},{0x45,2,ZeroPageX,4,0},{0x00,2,ZeroPageX,4,0},{0x28,2,ZeroPageX,6,0},{0x47,2,ZeroPageX,6,0},{0x2E,1,Implied,2,0},{0x00,3,AbsoluteY,4,1},{0x45,1,Implied,2,0},    {0x47,3,AbsoluteY,7,0},{0x45,3,AbsoluteX,4,1},{0x00,3,AbsoluteX,4,1},{0x28,3,AbsoluteX,7,0},{0x47,3,AbsoluteX,7,0},
 /*0x8_*/ {0x45,2,Immediate,2,0},{0x2F,2,IndirectX,6,0},{0x45,2,Immediate,2,0},{0x39,2,IndirectX,6,0},{0x31,2,ZeroPage,3,0}, {0x2F,2,ZeroPage,3,0}, {0x30,2,ZeroPage,3,0}, {0x39,2,ZeroPage,3,0}, {0x16,1,Implied,2,0},{0x45,2,Immediate,2,0},{0x35,1,Implied,2,0},    {0x4E,2,Immediate,2,0},{0x31,3,Absolute,4,0}, {0x2F,3,Absolute,4,0}, {0x30,3,Absolute,4,0}, {0x39,3,Absolute,4,0},
-/*0x9_*/ {0x03,2,Relative,2,1}, {0x2F,2,IndirectY,6,0},{0x42,1,Implied,0,0},  {0x3D,2,IndirectY,6,0},{0x31,2,ZeroPageX,4,0},{0x2F,2,ZeroPageX,4,0},{0x30,2,ZeroPageY,4,0},{0x39,2,ZeroPageY,4,0},{0x37,1,Implied,2,0},{0x2F,3,AbsoluteY,5,0},{0x36,1,Implied,2,0},    {0x4C,3,AbsoluteX,5,0},{0x4F,3,AbsoluteY,5,0},{0x2F,3,AbsoluteX,5,0},{0x4B,3,AbsoluteY,5,0},{0x3D,3,AbsoluteY,5,0},
+/*0x9_*/ {0x03,2,Relative,2,1}, {0x2F,2,IndirectY,6,0},{0x42,1,Implied,0,0},  {0x3D,2,IndirectY,6,0},{0x31,2,ZeroPageX,4,0},{0x2F,2,ZeroPageX,4,0},{0x30,2,ZeroPageY,4,0},{0x39,2,ZeroPageY,4,0},{0x37,1,Implied,2,0},{0x2F,3,AbsoluteY,5,0},{0x36,1,Implied,2,0},    {0x4F,3,AbsoluteY,5,0},{0x4C,3,AbsoluteX,5,0},{0x2F,3,AbsoluteX,5,0},{0x4B,3,AbsoluteY,5,0},{0x3D,3,AbsoluteY,5,0},
 /*0xA_*/ {0x1F,2,Immediate,2,0},{0x1D,2,IndirectX,6,0},{0x1E,2,Immediate,2,0},{0x44,2,IndirectX,6,0},{0x1F,2,ZeroPage,3,0}, {0x1D,2,ZeroPage,3,0}, {0x1E,2,ZeroPage,3,0}, {0x44,2,ZeroPage,3,0}, {0x33,1,Implied,2,0},{0x1D,2,Immediate,2,0},{0x32,1,Implied,2,0},    {0x3C,2,Immediate,2,0},{0x1F,3,Absolute,4,0}, {0x1D,3,Absolute,4,0}, {0x1E,3,Absolute,4,0}, {0x44,3,Absolute,4,0},
 /*0xB_*/ {0x04,2,Relative,2,1}, {0x1D,2,IndirectY,5,1},{0x42,1,Implied,0,0},  {0x44,2,IndirectY,5,1},{0x1F,2,ZeroPageX,4,0},{0x1D,2,ZeroPageX,4,0},{0x1E,2,ZeroPageY,4,0},{0x44,2,ZeroPageY,4,0},{0x10,1,Implied,2,0},{0x1D,3,AbsoluteY,4,1},{0x34,1,Implied,2,0},    {0x43,3,AbsoluteY,4,1},{0x1F,3,AbsoluteX,4,1},{0x1D,3,AbsoluteX,4,1},{0x1E,3,AbsoluteY,4,1},{0x44,3,AbsoluteY,4,1},
 /*0xC_*/ {0x13,2,Immediate,2,0},{0x11,2,IndirectX,6,0},{0x45,2,Immediate,2,0},{0x3F,2,IndirectX,8,0},{0x13,2,ZeroPage,3,0}, {0x11,2,ZeroPage,3,0}, {0x14,2,ZeroPage,5,0}, {0x3F,2,ZeroPage,5,0}, {0x1A,1,Implied,2,0},{0x11,2,Immediate,2,0},{0x15,1,Implied,2,0},    {0x3E,2,Immediate,2,0},{0x13,3,Absolute,4,0}, {0x11,3,Absolute,4,0}, {0x14,3,Absolute,6,0}, {0x3F,3,Absolute,6,0},
@@ -51,6 +60,32 @@ static const int OPCODES[0x100][5] = {
 };
 // clang-format on
 
+typedef struct BusAccess {
+  long cycle;
+  uint16_t addr;
+  uint8_t val;
+  bool write;
+} BusAccess;
+
+// The last backward jump, to spot loops that go around with nothing
+// changing
+typedef struct IdleLoop {
+  uint16_t jump_pc;
+  uint8_t regs[5];
+  long cycle;
+  // Cycles the last iteration took, 0 after the first
+  long period;
+
+  // The loop body only reads, checked once per loop
+  bool checked;
+  bool eligible;
+  bool reads_ppu;
+
+  // What $2002 read as one iteration ago, for loops polling it
+  bool status_known;
+  uint8_t ppu_status;
+} IdleLoop;
+
 typedef struct Bus Bus;
 typedef struct Cpu {
   Bus* bus;
@@ -63,11 +98,40 @@ typedef struct Cpu {
   uint16_t pc;
 
   int cycles_remaining;
-  int cycles_total;
+  long cycles_total;
   bool bounds_crossed;
+  // Instructions run, not counting interrupts or skipped idle loops
+  long instructions;
+
+  // Serviced before the next instruction
+  bool nmi_pending;
+  // Level triggered, held by the APU frame counter and DMC
+  bool irq_line;
+
+  // Print a nestest style log line before every instruction
+  bool trace;
+
+  // Issue every bus access on its own cycle, dummy reads and writes
+  // included, instead of doing all of an instruction's work up front
+  bool cycle_accurate;
+  // When set the cycle accurate core records every access here, wrapping
+  // around after access_log_size entries
+  BusAccess* access_log;
+  long access_log_size;
+  long access_count;
+
+  // Let cpu_run fast forward loops that only wait for an interrupt
+  bool skip_idle;
+  IdleLoop idle;
+  // Cycles skipped that way
+  long idle_cycles;
 } Cpu;
 
 // clang-format on
 
 Cpu cpu_init(Bus* bus);
+void cpu_reset(Cpu* cpu);
+// Runs one CPU cycle, executing an instruction at the start of it
 void cpu_execute(Cpu* cpu);
+// Runs whole instructions until cycles_total reaches until
+void cpu_run(Cpu* cpu, long until);
@@ -0,0 +1,324 @@
+#include "disasm.h"
+#include "bus.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BANK_SIZE 0x4000
+
+static Flow instruction_flow(int name_index, AddressingMode mode) {
+  switch (name_index) {
+    case NameJMP:
+      return mode == Indirect ? FlowStop : FlowJump;
+    case NameJSR:
+      return FlowCall;
+    case NameBRK:
+    case NameRTI:
+    case NameRTS:
+    case NameXKIL:
+      return FlowStop;
+    default:
+      return mode == Relative ? FlowBranch : FlowNext;
+  }
+}
+
+Instruction disasm_decode_bytes(uint16_t pc, const uint8_t* bytes) {
+  uint8_t opcode = bytes[0];
+  int name_index = OPCODES[opcode][0];
+
+  Instruction instr = {
+      .pc = pc,
+      .opcode = opcode,
+      .length = (uint8_t)OPCODES[opcode][1],
+      .mode = (AddressingMode)OPCODES[opcode][2],
+      .flow = instruction_flow(name_index, (AddressingMode)OPCODES[opcode][2]),
+      .name = OPCODES_NAMES[name_index],
+  };
+
+  if (instr.length == 2) {
+    instr.operand = bytes[1];
+  } else if (instr.length == 3) {
+    instr.operand = (uint16_t)(bytes[2] << 8 | bytes[1]);
+  }
+
+  if (instr.flow == FlowBranch) {
+    instr.target = (uint16_t)(pc + 2 + (int8_t)instr.operand);
+  } else if (instr.flow == FlowJump || instr.flow == FlowCall) {
+    instr.target = instr.operand;
+  }
+
+  return instr;
+}
+
+Instruction disasm_decode(Bus* bus, uint16_t pc) {
+  uint8_t bytes[3] = {mem_peek(bus, pc)};
+  int length = OPCODES[bytes[0]][1];
+  for (int i = 1; i < length; i++) {
+    bytes[i] = mem_peek(bus, (uint16_t)(pc + i));
+  }
+
+  return disasm_decode_bytes(pc, bytes);
+}
+
+int disasm_format(const Instruction* instr, char* out, size_t size) {
+  // Unofficial opcodes are marked with a leading '*'
+  const char* name = instr->name;
+  uint16_t val = instr->operand;
+
+  switch (instr->mode) {
+    case Accumulator:
+      return snprintf(out, size, "%s A", name);
+    case Immediate:
+      return snprintf(out, size, "%s #$%02X", name, val);
+    case ZeroPage:
+      return snprintf(out, size, "%s $%02X", name, val);
+    case ZeroPageX:
+      return snprintf(out, size, "%s $%02X,X", name, val);
+    case ZeroPageY:
+      return snprintf(out, size, "%s $%02X,Y", name, val);
+    case Relative:
+      return snprintf(out, size, "%s $%04X", name, instr->target);
+    case Absolute:
+      return snprintf(out, size, "%s $%04X", name, val);
+    case AbsoluteX:
+      return snprintf(out, size, "%s $%04X,X", name, val);
+    case AbsoluteY:
+      return snprintf(out, size, "%s $%04X,Y", name, val);
+    case Indirect:
+      return snprintf(out, size, "%s ($%04X)", name, val);
+    case IndirectX:
+      return snprintf(out, size, "%s ($%02X,X)", name, val);
+    case IndirectY:
+      return snprintf(out, size, "%s ($%02X),Y", name, val);
+    case Implied:
+      break;
+  }
+
+  return snprintf(out, size, "%s", name);
+}
+
+int disasm_format_operand(const Instruction* instr, Cpu* cpu, char* out,
+                          size_t size) {
+  Bus* bus = cpu->bus;
+  uint16_t val = instr->operand;
+  uint8_t zp = (uint8_t)val;
+
+  switch (instr->mode) {
+    case Accumulator:
+      return snprintf(out, size, "A");
+    case Immediate:
+      return snprintf(out, size, "#$%02X", val);
+    case ZeroPage:
+      return snprintf(out, size, "$%02X = %02X", val, mem_peek(bus, val));
+    case ZeroPageX:
+      return snprintf(out, size, "$%02X,X @ %02X = %02X", val,
+                      (uint8_t)(zp + cpu->x),
+                      mem_peek(bus, (uint8_t)(zp + cpu->x)));
+    case ZeroPageY:
+      return snprintf(out, size, "$%02X,Y @ %02X = %02X", val,
+                      (uint8_t)(zp + cpu->y),
+                      mem_peek(bus, (uint8_t)(zp + cpu->y)));
+    case Relative:
+      return snprintf(out, size, "$%04X", instr->target);
+    case Absolute:
+      // Jumps show where they go, everything else the value there
+      if (instr->flow == FlowJump || instr->flow == FlowCall) {
+        return snprintf(out, size, "$%04X", val);
+      }
+      return snprintf(out, size, "$%04X = %02X", val, mem_peek(bus, val));
+    case AbsoluteX:
+      return snprintf(out, size, "$%04X,X @ %04X = %02X", val,
+                      (uint16_t)(val + cpu->x),
+                      mem_peek(bus, (uint16_t)(val + cpu->x)));
+    case AbsoluteY:
+      return snprintf(out, size, "$%04X,Y @ %04X = %02X", val,
+                      (uint16_t)(val + cpu->y),
+                      mem_peek(bus, (uint16_t)(val + cpu->y)));
+    case Indirect: {
+      // 6502 page boundary bug
+      uint8_t lo = mem_peek(bus, val);
+      uint8_t hi = mem_peek(bus, (val & 0xFF00) | ((val + 1) & 0x00FF));
+      return snprintf(out, size, "($%04X) = %04X", val, hi << 8 | lo);
+    }
+    case IndirectX: {
+      uint8_t addr = (uint8_t)(zp + cpu->x);
+      uint8_t lo = mem_peek(bus, addr);
+      uint8_t hi = mem_peek(bus, (uint8_t)(addr + 1));
+      uint16_t final = (uint16_t)(hi << 8 | lo);
+      return snprintf(out, size, "($%02X,X) @ %02X = %04X = %02X", val, addr,
+                      final, mem_peek(bus, final));
+    }
+    case IndirectY: {
+      uint8_t lo = mem_peek(bus, zp);
+      uint8_t hi = mem_peek(bus, (uint8_t)(zp + 1));
+      uint16_t final = (uint16_t)((hi << 8 | lo) + cpu->y);
+      return snprintf(out, size, "($%02X),Y = %04X @ %04X = %02X", val,
+                      hi << 8 | lo, final, mem_peek(bus, final));
+    }
+    case Implied:
+      break;
+  }
+
+  if (size) {
+    out[0] = '\0';
+  }
+  return 0;
+}
+
+// === Static disassembly ==
+
+bool disasm_init(Disassembly* disasm, const unsigned char* rom) {
+  *disasm = (Disassembly){
+      .prg = rom + 0x10,
+      .prg_size = rom[4] * BANK_SIZE,
+      .bank_count = rom[4],
+  };
+
+  disasm->banks = calloc((size_t)disasm->bank_count, sizeof(DisasmBank));
+  return disasm->banks != NULL;
+}
+
+void disasm_free(Disassembly* disasm) {
+  for (int i = 0; i < disasm->bank_count; i++) {
+    free(disasm->banks[i].kinds);
+    free(disasm->banks[i].code);
+  }
+
+  free(disasm->banks);
+  disasm->banks = NULL;
+}
+
+// PRG offset of a CPU address at power on: 16K mirrored, 32K flat, bigger
+// ROMs with the first bank at $8000 and the last one at $C000
+static long prg_offset(const Disassembly* disasm, uint16_t addr) {
+  if (addr < 0x8000) {
+    return -1;
+  }
+
+  if (disasm->prg_size <= 2 * BANK_SIZE) {
+    return (addr - 0x8000) % disasm->prg_size;
+  }
+
+  if (addr < 0xC000) {
+    return addr - 0x8000;
+  }
+  return disasm->prg_size - BANK_SIZE + (addr - 0xC000);
+}
+
+// The last bank sits at $C000, a lone 16K bank is mirrored there too
+uint16_t disasm_bank_base(const Disassembly* disasm, int bank) {
+  return bank == disasm->bank_count - 1 ? 0xC000 : 0x8000;
+}
+
+static uint8_t* byte_kind(Disassembly* disasm, long offset) {
+  return &disasm->banks[offset / BANK_SIZE].kinds[offset % BANK_SIZE];
+}
+
+static Instruction decode_prg(const Disassembly* disasm, uint16_t pc) {
+  uint8_t bytes[3];
+  for (int i = 0; i < 3; i++) {
+    long offset = prg_offset(disasm, (uint16_t)(pc + i));
+    bytes[i] = offset < 0 ? 0 : disasm->prg[offset];
+  }
+
+  return disasm_decode_bytes(pc, bytes);
+}
+
+// Marks everything reachable from entry, a linear sweep that queues branch
+// and call targets on the way
+static void follow(Disassembly* disasm, uint16_t entry) {
+  uint16_t stack[0x1000];
+  int depth = 0;
+  stack[depth++] = entry;
+
+  while (depth) {
+    uint16_t pc = stack[--depth];
+
+    for (;;) {
+      long offset = prg_offset(disasm, pc);
+      // Code running from RAM can't be followed statically
+      if (offset < 0 || *byte_kind(disasm, offset) == ByteOpcode) {
+        break;
+      }
+
+      Instruction instr = decode_prg(disasm, pc);
+      *byte_kind(disasm, offset) = ByteOpcode;
+      for (int i = 1; i < instr.length; i++) {
+        long operand = prg_offset(disasm, (uint16_t)(pc + i));
+        if (operand >= 0 && *byte_kind(disasm, operand) == ByteUnknown) {
+          *byte_kind(disasm, operand) = ByteOperand;
+        }
+      }
+
+      if ((instr.flow == FlowBranch || instr.flow == FlowCall) &&
+          depth < (int)(sizeof(stack) / sizeof(stack[0]))) {
+        stack[depth++] = instr.target;
+      }
+
+      if (instr.flow == FlowStop) {
+        break;
+      }
+      pc = instr.flow == FlowJump ? instr.target
+                                  : (uint16_t)(pc + instr.length);
+    }
+  }
+}
+
+// Collects the instructions of a bank in address order
+static void collect(Disassembly* disasm, int bank) {
+  DisasmBank* result = &disasm->banks[bank];
+  uint16_t base = disasm_bank_base(disasm, bank);
+
+  long count = 0;
+  for (long i = 0; i < BANK_SIZE; i++) {
+    count += result->kinds[i] == ByteOpcode;
+  }
+
+  result->code = malloc((size_t)(count ? count : 1) * sizeof(Instruction));
+  for (long i = 0; i < BANK_SIZE; i++) {
+    if (result->kinds[i] == ByteOpcode) {
+      uint16_t pc = (uint16_t)(base + i);
+      const unsigned char* bytes = disasm->prg + bank * BANK_SIZE + i;
+      uint8_t copy[3] = {bytes[0]};
+      // Operands may run past the end of the bank
+      for (int j = 1; j < 3 && i + j < BANK_SIZE; j++) {
+        copy[j] = bytes[j];
+      }
+      result->code[result->code_count++] = disasm_decode_bytes(pc, copy);
+    }
+  }
+
+  result->decoded = true;
+}
+
+const DisasmBank* disasm_bank(Disassembly* disasm, int bank) {
+  if (bank < 0 || bank >= disasm->bank_count) {
+    return NULL;
+  }
+
+  if (disasm->banks[bank].decoded) {
+    return &disasm->banks[bank];
+  }
+
+  // Control flow crosses banks, so one pass covers every bank mapped at
+  // power on
+  for (int i = 0; i < disasm->bank_count; i++) {
+    if (!disasm->banks[i].kinds) {
+      disasm->banks[i].kinds = calloc(BANK_SIZE, 1);
+    }
+  }
+
+  const uint16_t vectors[] = {0xFFFA, 0xFFFC, 0xFFFE};
+  for (int i = 0; i < 3; i++) {
+    long lo = prg_offset(disasm, vectors[i]);
+    long hi = prg_offset(disasm, (uint16_t)(vectors[i] + 1));
+    follow(disasm, (uint16_t)(disasm->prg[hi] << 8 | disasm->prg[lo]));
+  }
+
+  for (int i = 0; i < disasm->bank_count; i++) {
+    if (!disasm->banks[i].decoded) {
+      collect(disasm, i);
+    }
+  }
+
+  return &disasm->banks[bank];
+}
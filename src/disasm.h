@@ -0,0 +1,67 @@
+#pragma once
+#include "cpu.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum Flow {
+  FlowNext,
+  FlowBranch,
+  FlowJump,
+  FlowCall,
+  // Returns, indirect jumps, BRK and KIL, nowhere known to go next
+  FlowStop,
+} Flow;
+
+typedef struct Instruction {
+  uint16_t pc;
+  uint8_t opcode;
+  uint8_t length;
+  // Little endian, 8 bits for zero page, immediate and relative operands
+  uint16_t operand;
+  // Where branches, jumps and calls go
+  uint16_t target;
+  AddressingMode mode;
+  Flow flow;
+  const char* name;
+} Instruction;
+
+// Decodes without side effects, using mem_peek
+Instruction disasm_decode(Bus* bus, uint16_t pc);
+// Decodes from up to three bytes already in hand
+Instruction disasm_decode_bytes(uint16_t pc, const uint8_t* bytes);
+
+// "LDA $10,X", returns the length like snprintf
+int disasm_format(const Instruction* instr, char* out, size_t size);
+// nestest style operand with the effective address and the value there,
+// "$10,X @ 12 = 34"
+int disasm_format_operand(const Instruction* instr, Cpu* cpu, char* out,
+                          size_t size);
+
+typedef enum ByteKind { ByteUnknown, ByteOpcode, ByteOperand } ByteKind;
+
+// Results for one 16K PRG bank, found by following control flow
+typedef struct DisasmBank {
+  bool decoded;
+  // One ByteKind per byte
+  uint8_t* kinds;
+  // Sorted by address
+  Instruction* code;
+  long code_count;
+} DisasmBank;
+
+// Static disassembly of a whole PRG ROM, each bank is decoded once and
+// cached
+typedef struct Disassembly {
+  const unsigned char* prg;
+  long prg_size;
+  int bank_count;
+  DisasmBank* banks;
+} Disassembly;
+
+bool disasm_init(Disassembly* disasm, const unsigned char* rom);
+void disasm_free(Disassembly* disasm);
+
+const DisasmBank* disasm_bank(Disassembly* disasm, int bank);
+// CPU address of the first byte of a bank as mapped at power on
+uint16_t disasm_bank_base(const Disassembly* disasm, int bank);
@@ -0,0 +1,105 @@
+#include "emulator.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE 64
+
+static size_t align_up(size_t size) {
+  return (size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+static size_t arena_size(bool chr_ram) {
+  return align_up(sizeof(Emulator)) + align_up(CPU_RAM_SIZE) +
+         align_up(PRG_RAM_SIZE) + (chr_ram ? align_up(CHR_RAM_SIZE) : 0) +
+         align_up(PPU_WIDTH * PPU_HEIGHT);
+}
+
+// Puts every block on its own cache lines after the Emulator itself
+static BusMemory layout(unsigned char* base, bool chr_ram) {
+  BusMemory memory;
+  unsigned char* next = base + align_up(sizeof(Emulator));
+
+  memory.cpu_ram = next;
+  next += align_up(CPU_RAM_SIZE);
+  memory.prg_ram = next;
+  next += align_up(PRG_RAM_SIZE);
+  memory.chr_ram = chr_ram ? next : NULL;
+  next += chr_ram ? align_up(CHR_RAM_SIZE) : 0;
+  memory.framebuffer = next;
+
+  return memory;
+}
+
+static void power_on(Emulator* emu) {
+  emu->bus = bus_init_in(emu->rom, &emu->memory);
+  emu->cpu = cpu_init(&emu->bus);
+  emu->bus.cpu = &emu->cpu;
+}
+
+Emulator* emu_create(unsigned char* rom) {
+  bool chr_ram = !rom[5];
+  size_t size = arena_size(chr_ram);
+
+  unsigned char* base = aligned_alloc(CACHE_LINE, size);
+  if (!base) {
+    return NULL;
+  }
+  memset(base, 0, size);
+
+  Emulator* emu = (Emulator*)base;
+  emu->rom = rom;
+  emu->memory = layout(base, chr_ram);
+  emu->memory_size = size;
+
+  power_on(emu);
+  return emu;
+}
+
+void emu_reset(Emulator* emu) {
+  // Everything after the struct is component memory
+  size_t header = align_up(sizeof(Emulator));
+  memset((unsigned char*)emu + header, 0, emu->memory_size - header);
+
+  uint8_t* prg_ram = emu->bus.prg_ram;
+  power_on(emu);
+  emu->bus.prg_ram = prg_ram;
+}
+
+void emu_destroy(Emulator* emu) {
+  if (!emu) {
+    return;
+  }
+
+  bus_unmap_save(&emu->bus);
+  free(emu);
+}
+
+void emu_pool_init(EmulatorPool* pool, unsigned char* rom) {
+  *pool = (EmulatorPool){.rom = rom};
+}
+
+void emu_pool_free(EmulatorPool* pool) {
+  while (pool->free_list) {
+    Emulator* emu = pool->free_list;
+    pool->free_list = emu->next_free;
+    emu_destroy(emu);
+  }
+}
+
+Emulator* emu_pool_acquire(EmulatorPool* pool) {
+  Emulator* emu = pool->free_list;
+  if (!emu) {
+    pool->created++;
+    return emu_create(pool->rom);
+  }
+
+  pool->free_list = emu->next_free;
+  pool->reused++;
+  emu_reset(emu);
+  return emu;
+}
+
+void emu_pool_release(EmulatorPool* pool, Emulator* emu) {
+  emu->next_free = pool->free_list;
+  pool->free_list = emu;
+}
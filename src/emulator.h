@@ -0,0 +1,43 @@
+#pragma once
+#include "bus.h"
+#include "cpu.h"
+#include <stddef.h>
+
+// A whole console in one cache line aligned block: the CPU, the bus with
+// its components, and all the memory they work in
+typedef struct Emulator {
+  Cpu cpu;
+  Bus bus;
+
+  // Borrowed from the caller, must outlive the emulator
+  unsigned char* rom;
+  BusMemory memory;
+  size_t memory_size;
+
+  // Next free emulator while in a pool
+  struct Emulator* next_free;
+} Emulator;
+
+// Powered on like cpu_init leaves the CPU, NULL if out of memory
+Emulator* emu_create(unsigned char* rom);
+// Back to how emu_create left it, with all RAM cleared. A mapped save file
+// stays mapped and keeps its contents.
+void emu_reset(Emulator* emu);
+void emu_destroy(Emulator* emu);
+
+// Recycles emulators of one ROM, so short runs don't go through the
+// allocator every time
+typedef struct EmulatorPool {
+  unsigned char* rom;
+  Emulator* free_list;
+  long created;
+  long reused;
+} EmulatorPool;
+
+void emu_pool_init(EmulatorPool* pool, unsigned char* rom);
+// Destroys the emulators in the pool, ones still acquired are not touched
+void emu_pool_free(EmulatorPool* pool);
+
+// A freshly reset emulator, NULL if out of memory
+Emulator* emu_pool_acquire(EmulatorPool* pool);
+void emu_pool_release(EmulatorPool* pool, Emulator* emu);
@@ -0,0 +1,82 @@
+#include "env.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The framebuffer is the last block of the arena, so leaving it out of a
+// snapshot is just a shorter copy
+static size_t state_size(const Emulator* emu, bool render) {
+  size_t framebuffer_offset =
+      (size_t)(emu->memory.framebuffer - (const uint8_t*)emu);
+  return render ? emu->memory_size : framebuffer_offset;
+}
+
+static const EnvObservation* observe(Env* env) {
+  env->observation.frame = env->emu->bus.ppu.frame;
+  return &env->observation;
+}
+
+Env* env_create(unsigned char* rom, bool render) {
+  Env* env = calloc(1, sizeof(Env));
+  if (!env) {
+    return NULL;
+  }
+
+  env->emu = emu_create(rom);
+  env->render = render;
+  if (env->emu) {
+    env->snapshot_size = state_size(env->emu, render);
+    env->snapshot = malloc(env->snapshot_size);
+  }
+  if (!env->emu || !env->snapshot) {
+    env_destroy(env);
+    return NULL;
+  }
+
+  Emulator* emu = env->emu;
+  cpu_reset(&emu->cpu);
+  emu->bus.ppu.render = render;
+  env->observation = (EnvObservation){
+      .ram = emu->bus.cpu_ram,
+      .framebuffer = emu->memory.framebuffer,
+  };
+
+  env_snapshot(env);
+  return env;
+}
+
+void env_destroy(Env* env) {
+  if (!env) {
+    return;
+  }
+
+  free(env->snapshot);
+  emu_destroy(env->emu);
+  free(env);
+}
+
+// Everything in the arena points back into it, so a copy restored to the
+// same place is a complete state
+void env_snapshot(Env* env) {
+  memcpy(env->snapshot, env->emu, env->snapshot_size);
+}
+
+const EnvObservation* env_reset(Env* env) {
+  memcpy(env->emu, env->snapshot, env->snapshot_size);
+  return observe(env);
+}
+
+const EnvObservation* env_step(Env* env, uint8_t buttons, int frames) {
+  Cpu* cpu = &env->emu->cpu;
+  Ppu* ppu = &env->emu->bus.ppu;
+  env->emu->bus.controllers[0].buttons = buttons;
+
+  for (int i = 0; i < frames; i++) {
+    // Vblank is always an event, so this stops right on it
+    while (!ppu->frame_complete) {
+      cpu_run(cpu, cpu->bus->next_event);
+    }
+    ppu->frame_complete = false;
+  }
+
+  return observe(env);
+}
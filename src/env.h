@@ -0,0 +1,40 @@
+#pragma once
+#include "emulator.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// What an agent sees after a step. The pointers stay valid for the life of
+// the environment and are updated in place, nothing is copied.
+typedef struct EnvObservation {
+  // CPU_RAM_SIZE bytes
+  const uint8_t* ram;
+  // Palette indices, PPU_WIDTH * PPU_HEIGHT, only drawn when rendering
+  const uint8_t* framebuffer;
+  long frame;
+} EnvObservation;
+
+// A step/reset loop around one emulator for agents and search. Steps and
+// resets never allocate.
+typedef struct Env {
+  Emulator* emu;
+  bool render;
+
+  // The arena as of env_snapshot, without the framebuffer unless rendering
+  unsigned char* snapshot;
+  size_t snapshot_size;
+
+  EnvObservation observation;
+} Env;
+
+// Powers on and resets, and takes the first snapshot there. The ROM must
+// outlive the environment. NULL if out of memory.
+Env* env_create(unsigned char* rom, bool render);
+void env_destroy(Env* env);
+
+// Makes the current state the one env_reset goes back to
+void env_snapshot(Env* env);
+// Back to the last snapshot, a single copy of the emulator's memory
+const EnvObservation* env_reset(Env* env);
+// Holds buttons (a Button mask) on controller 1 for that many frames
+const EnvObservation* env_step(Env* env, uint8_t buttons, int frames);
@@ -0,0 +1,139 @@
+#include "framehash.h"
+#include "palette.h"
+#include "ppu.h"
+#include "util.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int compare_frames(const void* a, const void* b) {
+  long one = ((const FrameHash*)a)->frame;
+  long two = ((const FrameHash*)b)->frame;
+  return (one > two) - (one < two);
+}
+
+bool manifest_load(FrameManifest* manifest, const char* path, bool update) {
+  *manifest = (FrameManifest){.path = path, .update = update};
+
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+
+  long capacity = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    char* end;
+    long frame = strtol(line, &end, 10);
+    if (end == line || frame <= 0) {
+      continue;
+    }
+
+    if (manifest->count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      FrameHash* entries =
+          realloc(manifest->entries, (size_t)capacity * sizeof(FrameHash));
+      if (!entries) {
+        fclose(file);
+        manifest_free(manifest);
+        return false;
+      }
+      manifest->entries = entries;
+    }
+
+    FrameHash* entry = &manifest->entries[manifest->count++];
+    char* hash_end;
+    *entry = (FrameHash){.frame = frame, .hash = strtoull(end, &hash_end, 16)};
+    entry->has_hash = hash_end != end;
+  }
+
+  fclose(file);
+
+  qsort(manifest->entries, (size_t)manifest->count, sizeof(FrameHash),
+        compare_frames);
+  return true;
+}
+
+bool manifest_save(const FrameManifest* manifest) {
+  FILE* file = fopen(manifest->path, "w");
+  if (!file) {
+    return false;
+  }
+
+  for (long i = 0; i < manifest->count; i++) {
+    const FrameHash* entry = &manifest->entries[i];
+    if (entry->has_hash) {
+      fprintf(file, "%ld %016" PRIx64 "\n", entry->frame, entry->hash);
+    } else {
+      fprintf(file, "%ld\n", entry->frame);
+    }
+  }
+
+  return fclose(file) == 0;
+}
+
+void manifest_free(FrameManifest* manifest) {
+  free(manifest->entries);
+  manifest->entries = NULL;
+}
+
+bool manifest_wants(const FrameManifest* manifest, long frame) {
+  return manifest->next < manifest->count &&
+         manifest->entries[manifest->next].frame == frame;
+}
+
+long manifest_last_frame(const FrameManifest* manifest) {
+  return manifest->count ? manifest->entries[manifest->count - 1].frame : 0;
+}
+
+static void dump_ppm(const FrameManifest* manifest, long frame,
+                     const uint8_t* framebuffer) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.%ld.ppm", manifest->path, frame);
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return;
+  }
+
+  fprintf(file, "P6\n%d %d\n255\n", PPU_WIDTH, PPU_HEIGHT);
+
+  uint8_t line[PPU_WIDTH * 3];
+  for (int y = 0; y < PPU_HEIGHT; y++) {
+    const uint8_t* in = framebuffer + y * PPU_WIDTH;
+    for (int x = 0; x < PPU_WIDTH; x++) {
+      const uint8_t* rgb = PALETTE_RGB[in[x] & 0x3F];
+      line[x * 3] = rgb[0];
+      line[x * 3 + 1] = rgb[1];
+      line[x * 3 + 2] = rgb[2];
+    }
+    fwrite(line, 1, sizeof(line), file);
+  }
+
+  fclose(file);
+  printf("Wrote %s\n", path);
+}
+
+void manifest_check(FrameManifest* manifest, long frame,
+                    const uint8_t* framebuffer) {
+  uint64_t hash = hash_xxh64(framebuffer, PPU_WIDTH * PPU_HEIGHT, 0);
+
+  // Duplicate lines for the same frame are all checked against it
+  while (manifest_wants(manifest, frame)) {
+    FrameHash* entry = &manifest->entries[manifest->next++];
+
+    if (manifest->update) {
+      entry->has_hash = true;
+      entry->hash = hash;
+    } else if (!entry->has_hash) {
+      printf("Frame %ld: %016" PRIx64 " (no hash in manifest)\n", frame, hash);
+      manifest->missing++;
+    } else if (entry->hash != hash) {
+      printf("Frame %ld: %016" PRIx64 ", manifest expects %016" PRIx64 "\n",
+             frame, hash, entry->hash);
+      manifest->mismatches++;
+      dump_ppm(manifest, frame, framebuffer);
+    }
+  }
+}
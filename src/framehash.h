@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct FrameHash {
+  long frame;
+  bool has_hash;
+  uint64_t hash;
+} FrameHash;
+
+// A list of frame numbers and the framebuffer hash expected after each one,
+// one "FRAME [HASH]" per line sorted by frame. Entries without a hash only
+// get one when updating.
+typedef struct FrameManifest {
+  const char* path;
+  FrameHash* entries;
+  long count;
+
+  // Record hashes instead of comparing them
+  bool update;
+
+  // Next entry to check
+  long next;
+  long mismatches;
+  long missing;
+} FrameManifest;
+
+bool manifest_load(FrameManifest* manifest, const char* path, bool update);
+bool manifest_save(const FrameManifest* manifest);
+void manifest_free(FrameManifest* manifest);
+
+// Whether the frame is listed, so the runner only renders frames it needs
+bool manifest_wants(const FrameManifest* manifest, long frame);
+// Frame of the last entry, 0 if empty
+long manifest_last_frame(const FrameManifest* manifest);
+
+// Checks the framebuffer of a listed frame. Mismatching frames are dumped
+// as PPM next to the manifest.
+void manifest_check(FrameManifest* manifest, long frame,
+                    const uint8_t* framebuffer);
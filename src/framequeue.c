@@ -0,0 +1,97 @@
+#include "framequeue.h"
+#include <stdlib.h>
+#include <time.h>
+
+bool frame_queue_init(FrameQueue* queue, long size) {
+  *queue = (FrameQueue){
+      .slots = calloc((size_t)size, sizeof(FrameSlot)),
+      .size = size,
+  };
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+
+  return queue->slots != NULL;
+}
+
+void frame_queue_free(FrameQueue* queue) {
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+FrameSlot* frame_queue_acquire(FrameQueue* queue) {
+  long head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  long tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head + queue->acquired - tail >= queue->size) {
+    queue->dropped++;
+    return NULL;
+  }
+
+  return &queue->slots[(head + queue->acquired++) % queue->size];
+}
+
+FrameSlot* frame_queue_acquire_wait(FrameQueue* queue) {
+  const struct timespec pause = {.tv_nsec = 100000};
+
+  for (;;) {
+    long head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    long tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head + queue->acquired - tail < queue->size) {
+      return &queue->slots[(head + queue->acquired++) % queue->size];
+    }
+
+    queue->waited++;
+    nanosleep(&pause, NULL);
+  }
+}
+
+void frame_queue_publish(FrameQueue* queue) {
+  if (!queue->acquired) {
+    return;
+  }
+
+  queue->acquired--;
+  long head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+FrameSlot* frame_queue_present(FrameQueue* queue) {
+  long head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  long tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  if (!queue->holding) {
+    if (head == tail) {
+      return NULL;
+    }
+
+    queue->holding = true;
+    return &queue->slots[tail % queue->size];
+  }
+
+  if (head - tail > 1) {
+    // Something newer than the held frame, hand the held slot back
+    tail++;
+    atomic_store_explicit(&queue->tail, tail, memory_order_release);
+  } else {
+    queue->duplicated++;
+  }
+
+  return &queue->slots[tail % queue->size];
+}
+
+FrameSlot* frame_queue_next(FrameQueue* queue) {
+  long head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  long tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  if (head == tail) {
+    return NULL;
+  }
+
+  return &queue->slots[tail % queue->size];
+}
+
+void frame_queue_release(FrameQueue* queue) {
+  long tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
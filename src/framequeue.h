@@ -0,0 +1,57 @@
+#pragma once
+#include "ppu.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Enough for one NTSC frame at 48kHz
+#define FRAME_AUDIO_SAMPLES 1024
+
+typedef struct FrameSlot {
+  uint8_t pixels[PPU_WIDTH * PPU_HEIGHT];
+  int16_t audio[FRAME_AUDIO_SAMPLES];
+  int audio_count;
+  long frame;
+} FrameSlot;
+
+// Single producer, single consumer ring of frames. The producer (emulation
+// thread) never waits: when every slot is taken the frame is dropped, and
+// the consumer shows the frame it already holds again when nothing new is
+// ready. Three slots give triple buffering.
+typedef struct FrameQueue {
+  FrameSlot* slots;
+  long size;
+
+  // Frames published so far, only written by the producer
+  atomic_long head;
+  // Frames released so far, only written by the consumer
+  atomic_long tail;
+
+  // Producer side, slots handed out and not yet published
+  long acquired;
+  long dropped;
+  long waited;
+
+  // Consumer side
+  bool holding;
+  long duplicated;
+} FrameQueue;
+
+bool frame_queue_init(FrameQueue* queue, long size);
+void frame_queue_free(FrameQueue* queue);
+
+// Producer: returns a slot to fill or NULL if the frame has to be dropped.
+// Several slots may be held at once, they are published oldest first.
+FrameSlot* frame_queue_acquire(FrameQueue* queue);
+// Producer, lossless: sleeps until the consumer frees a slot
+FrameSlot* frame_queue_acquire_wait(FrameQueue* queue);
+void frame_queue_publish(FrameQueue* queue);
+
+// Consumer, presentation style: returns the newest frame in order, or the
+// held one again if nothing newer is ready. NULL until the first frame.
+FrameSlot* frame_queue_present(FrameQueue* queue);
+
+// Consumer, encoder style: every frame in order, NULL when empty. Release
+// each frame once done with it.
+FrameSlot* frame_queue_next(FrameQueue* queue);
+void frame_queue_release(FrameQueue* queue);
@@ -0,0 +1,532 @@
+#include "gdb.h"
+#include "breakpoint.h"
+#include "bus.h"
+#include "cpu.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define PACKET_SIZE 0x1000
+
+static const int SIGNAL_INT = 2;
+static const int SIGNAL_TRAP = 5;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+
+  return -1;
+}
+
+static char* put_hex8(char* out, uint8_t val) {
+  *out++ = HEX_DIGITS[val >> 4];
+  *out++ = HEX_DIGITS[val & 0xF];
+  return out;
+}
+
+static uint8_t get_hex8(const char* in) {
+  return (uint8_t)((hex_value(in[0]) << 4) | hex_value(in[1]));
+}
+
+static unsigned long parse_hex(const char** in) {
+  unsigned long val = 0;
+  int digit;
+  while ((digit = hex_value(**in)) >= 0) {
+    val = (val << 4) | (unsigned long)digit;
+    (*in)++;
+  }
+
+  return val;
+}
+
+static void send_packet(GdbServer* gdb, const char* data) {
+  char packet[PACKET_SIZE + 4];
+  size_t len = strlen(data);
+  uint8_t checksum = 0;
+
+  packet[0] = '$';
+  for (size_t i = 0; i < len; i++) {
+    packet[i + 1] = data[i];
+    checksum += (uint8_t)data[i];
+  }
+  packet[len + 1] = '#';
+  put_hex8(packet + len + 2, checksum);
+
+  if (write(gdb->client_fd, packet, len + 4) < 0) {
+    perror("gdb write");
+  }
+}
+
+static void send_stop_reply(GdbServer* gdb) {
+  char reply[32];
+  Breakpoints* bp = gdb->breakpoints;
+
+  if (bp->reason == BreakRead || bp->reason == BreakWrite) {
+    snprintf(reply, sizeof(reply), "T%02x%s:%04x;", gdb->stop_signal,
+             bp->reason == BreakRead ? "rwatch" : "watch", bp->address);
+  } else {
+    snprintf(reply, sizeof(reply), "S%02x", gdb->stop_signal);
+  }
+
+  send_packet(gdb, reply);
+}
+
+// === Packet handlers, only called while the core is stopped ==
+
+static void read_registers(GdbServer* gdb, char* out) {
+  Cpu* cpu = gdb->cpu;
+  out = put_hex8(out, cpu->a);
+  out = put_hex8(out, cpu->x);
+  out = put_hex8(out, cpu->y);
+  out = put_hex8(out, cpu->status);
+  out = put_hex8(out, cpu->sp);
+  out = put_hex8(out, cpu->pc & 0xFF);
+  out = put_hex8(out, cpu->pc >> 8);
+  *out = '\0';
+}
+
+static bool write_register(GdbServer* gdb, unsigned long reg, const char* in) {
+  Cpu* cpu = gdb->cpu;
+  switch (reg) {
+    case 0:
+      cpu->a = get_hex8(in);
+      return true;
+    case 1:
+      cpu->x = get_hex8(in);
+      return true;
+    case 2:
+      cpu->y = get_hex8(in);
+      return true;
+    case 3:
+      cpu->status = get_hex8(in);
+      return true;
+    case 4:
+      cpu->sp = get_hex8(in);
+      return true;
+    case 5:
+      cpu->pc = (uint16_t)(get_hex8(in) | (get_hex8(in + 2) << 8));
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void handle_breakpoint(GdbServer* gdb, const char* packet, char* out) {
+  bool insert = packet[0] == 'Z';
+  const char* in = packet + 1;
+  unsigned long type = parse_hex(&in);
+  in++;
+  uint16_t addr = (uint16_t)parse_hex(&in);
+  in++;
+  unsigned long len = parse_hex(&in);
+  if (len == 0) {
+    len = 1;
+  }
+
+  Breakpoints* bp = gdb->breakpoints;
+  uint16_t end = (uint16_t)(addr + len - 1);
+  bool ok;
+
+  switch (type) {
+    // Software and hardware breakpoints are the same thing here
+    case 0:
+    case 1:
+      ok = insert ? breakpoint_add(bp, addr) : breakpoint_remove(bp, addr);
+      break;
+    case 2:
+    case 3:
+    case 4: {
+      int kind = type == 2 ? WatchWrite
+                 : type == 3 ? WatchRead
+                             : WatchRead | WatchWrite;
+      ok = insert ? watchpoint_add(bp, (Watchpoint){.start = addr,
+                                                    .end = end,
+                                                    .kind = kind})
+                  : watchpoint_remove(bp, addr, end, kind);
+      break;
+    }
+    default:
+      out[0] = '\0';
+      return;
+  }
+
+  strcpy(out, ok || !insert ? "OK" : "E01");
+}
+
+static void resume(GdbServer* gdb, bool step) {
+  pthread_mutex_lock(&gdb->lock);
+  gdb->running = true;
+  gdb->stepping = step;
+  pthread_cond_signal(&gdb->cond);
+  pthread_mutex_unlock(&gdb->lock);
+}
+
+static void handle_packet(GdbServer* gdb, char* packet) {
+  char out[PACKET_SIZE];
+  out[0] = '\0';
+
+  const char* in = packet + 1;
+  Bus* bus = gdb->cpu->bus;
+
+  switch (packet[0]) {
+    case '?':
+      snprintf(out, sizeof(out), "S%02x", gdb->stop_signal);
+      break;
+    case 'g':
+      read_registers(gdb, out);
+      break;
+    case 'G':
+      // Five 8-bit registers and the PC
+      if (strlen(in) < 14) {
+        strcpy(out, "E01");
+        break;
+      }
+      for (unsigned long reg = 0; reg < 6; reg++) {
+        write_register(gdb, reg, in + reg * 2);
+      }
+      strcpy(out, "OK");
+      break;
+    case 'p': {
+      char regs[16];
+      unsigned long reg = parse_hex(&in);
+      read_registers(gdb, regs);
+      if (reg < 5) {
+        snprintf(out, sizeof(out), "%.2s", regs + reg * 2);
+      } else if (reg == 5) {
+        snprintf(out, sizeof(out), "%.4s", regs + 10);
+      } else {
+        strcpy(out, "E01");
+      }
+      break;
+    }
+    case 'P': {
+      unsigned long reg = parse_hex(&in);
+      in++;
+      bool complete = strlen(in) >= (reg == 5 ? 4 : 2);
+      strcpy(out, complete && write_register(gdb, reg, in) ? "OK" : "E01");
+      break;
+    }
+    case 'm': {
+      uint16_t addr = (uint16_t)parse_hex(&in);
+      in++;
+      unsigned long len = parse_hex(&in);
+      if (len > PACKET_SIZE / 2 - 1) {
+        len = PACKET_SIZE / 2 - 1;
+      }
+
+      char* cursor = out;
+      for (unsigned long i = 0; i < len; i++) {
+        cursor = put_hex8(cursor, mem_peek(bus, (uint16_t)(addr + i)));
+      }
+      *cursor = '\0';
+      break;
+    }
+    case 'M': {
+      uint16_t addr = (uint16_t)parse_hex(&in);
+      in++;
+      unsigned long len = parse_hex(&in);
+      if (*in != ':') {
+        strcpy(out, "E01");
+        break;
+      }
+      in++;
+      // Only as much as was sent, the length comes from the client
+      if (len > strlen(in) / 2) {
+        strcpy(out, "E01");
+        break;
+      }
+      for (unsigned long i = 0; i < len; i++) {
+        mem_poke(bus, (uint16_t)(addr + i), get_hex8(in + i * 2));
+      }
+      strcpy(out, "OK");
+      break;
+    }
+    case 'Z':
+    case 'z':
+      handle_breakpoint(gdb, packet, out);
+      break;
+    case 'c':
+    case 's':
+      if (*in) {
+        gdb->cpu->pc = (uint16_t)parse_hex(&in);
+      }
+      // The stop reply is sent once the core stops
+      resume(gdb, packet[0] == 's');
+      return;
+    case 'H':
+      strcpy(out, "OK");
+      break;
+    case 'q':
+      if (strncmp(packet, "qSupported", 10) == 0) {
+        snprintf(out, sizeof(out), "PacketSize=%x", PACKET_SIZE);
+      } else if (strcmp(packet, "qAttached") == 0) {
+        strcpy(out, "1");
+      }
+      break;
+    case 'D':
+      // Drop all breakpoints and let the game run freely
+      breakpoints_init(gdb->breakpoints, bus);
+      send_packet(gdb, "OK");
+      resume(gdb, false);
+      return;
+    case 'k':
+      pthread_mutex_lock(&gdb->lock);
+      gdb->quit = true;
+      pthread_cond_signal(&gdb->cond);
+      pthread_mutex_unlock(&gdb->lock);
+      return;
+    default:
+      break;
+  }
+
+  send_packet(gdb, out);
+}
+
+static bool is_running(GdbServer* gdb) {
+  pthread_mutex_lock(&gdb->lock);
+  bool running = gdb->running;
+  pthread_mutex_unlock(&gdb->lock);
+  return running;
+}
+
+// Pulls complete packets out of the receive buffer, returns how many bytes
+// were consumed
+static size_t process_input(GdbServer* gdb, char* buf, size_t len) {
+  size_t pos = 0;
+
+  while (pos < len) {
+    char c = buf[pos];
+
+    // Ctrl-C
+    if (c == 0x03) {
+      atomic_store(&gdb->interrupt, true);
+      pos++;
+      continue;
+    }
+
+    if (c != '$') {
+      // Acks and noise
+      pos++;
+      continue;
+    }
+
+    char* end = memchr(buf + pos, '#', len - pos);
+    if (!end || (size_t)(end - buf) + 3 > len) {
+      // Incomplete packet, wait for more data
+      break;
+    }
+
+    *end = '\0';
+    char* packet = buf + pos + 1;
+    pos = (size_t)(end - buf) + 3;
+
+    if (write(gdb->client_fd, "+", 1) < 0) {
+      perror("gdb write");
+    }
+
+    if (is_running(gdb)) {
+      // Only an interrupt makes sense while the core runs
+      continue;
+    }
+
+    handle_packet(gdb, packet);
+  }
+
+  return pos;
+}
+
+static void serve_client(GdbServer* gdb) {
+  char buf[PACKET_SIZE * 2];
+  size_t len = 0;
+
+  for (;;) {
+    struct pollfd fds[2] = {
+        {.fd = gdb->client_fd, .events = POLLIN},
+        {.fd = gdb->wake_pipe[0], .events = POLLIN},
+    };
+
+    if (poll(fds, 2, -1) < 0) {
+      perror("gdb poll");
+      return;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char dummy;
+      if (read(gdb->wake_pipe[0], &dummy, 1) == 1) {
+        send_stop_reply(gdb);
+      }
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP)) {
+      ssize_t got = read(gdb->client_fd, buf + len, sizeof(buf) - len - 1);
+      if (got <= 0) {
+        return;
+      }
+      len += (size_t)got;
+
+      size_t used = process_input(gdb, buf, len);
+      memmove(buf, buf + used, len - used);
+      len -= used;
+
+      // Drop garbage that can never form a packet
+      if (len == sizeof(buf) - 1) {
+        len = 0;
+      }
+
+      pthread_mutex_lock(&gdb->lock);
+      bool quit = gdb->quit;
+      pthread_mutex_unlock(&gdb->lock);
+      if (quit) {
+        return;
+      }
+    }
+  }
+}
+
+// A new debugger expects the target to be stopped
+static void halt_core(GdbServer* gdb) {
+  char dummy;
+
+  if (is_running(gdb)) {
+    atomic_store(&gdb->interrupt, true);
+    if (read(gdb->wake_pipe[0], &dummy, 1) < 0) {
+      perror("gdb wake");
+    }
+  }
+
+  // Drop stop notifications nobody was connected to receive
+  struct pollfd fd = {.fd = gdb->wake_pipe[0], .events = POLLIN};
+  while (poll(&fd, 1, 0) > 0 && read(gdb->wake_pipe[0], &dummy, 1) == 1) {
+  }
+}
+
+static void* server_thread(void* arg) {
+  GdbServer* gdb = arg;
+
+  for (;;) {
+    gdb->client_fd = accept(gdb->listen_fd, NULL, NULL);
+    if (gdb->client_fd < 0) {
+      perror("gdb accept");
+      continue;
+    }
+
+    halt_core(gdb);
+
+    serve_client(gdb);
+    close(gdb->client_fd);
+
+    pthread_mutex_lock(&gdb->lock);
+    bool quit = gdb->quit;
+    pthread_mutex_unlock(&gdb->lock);
+    if (quit) {
+      return NULL;
+    }
+  }
+}
+
+bool gdb_start(GdbServer* gdb, Cpu* cpu, Breakpoints* breakpoints, int port) {
+  *gdb = (GdbServer){
+      .cpu = cpu,
+      .breakpoints = breakpoints,
+      .stop_signal = SIGNAL_TRAP,
+  };
+  atomic_init(&gdb->interrupt, false);
+  pthread_mutex_init(&gdb->lock, NULL);
+  pthread_cond_init(&gdb->cond, NULL);
+
+  if (pipe(gdb->wake_pipe) < 0) {
+    perror("gdb pipe");
+    return false;
+  }
+
+  gdb->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (gdb->listen_fd < 0) {
+    perror("gdb socket");
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(gdb->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr = {
+      .sin_family = AF_INET,
+      .sin_port = htons((uint16_t)port),
+      .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  if (bind(gdb->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(gdb->listen_fd, 1) < 0) {
+    perror("gdb bind");
+    close(gdb->listen_fd);
+    return false;
+  }
+
+  printf("Waiting for gdb on localhost:%i\n", port);
+  return pthread_create(&gdb->thread, NULL, server_thread, gdb) == 0;
+}
+
+// Runs until a breakpoint, a completed step or an interrupt. Always stops on
+// an instruction boundary.
+static int run_core(GdbServer* gdb, bool step) {
+  Cpu* cpu = gdb->cpu;
+  Breakpoints* bp = gdb->breakpoints;
+
+  breakpoints_resume(bp);
+
+  for (;;) {
+    cpu_execute(cpu);
+    if (cpu->cycles_remaining) {
+      continue;
+    }
+
+    if (bp->stopped || step) {
+      return SIGNAL_TRAP;
+    }
+
+    if (atomic_load_explicit(&gdb->interrupt, memory_order_relaxed)) {
+      atomic_store(&gdb->interrupt, false);
+      return SIGNAL_INT;
+    }
+  }
+}
+
+void gdb_run(GdbServer* gdb) {
+  for (;;) {
+    pthread_mutex_lock(&gdb->lock);
+    while (!gdb->running && !gdb->quit) {
+      pthread_cond_wait(&gdb->cond, &gdb->lock);
+    }
+    bool quit = gdb->quit;
+    bool step = gdb->stepping;
+    pthread_mutex_unlock(&gdb->lock);
+
+    if (quit) {
+      return;
+    }
+
+    int signal = run_core(gdb, step);
+
+    pthread_mutex_lock(&gdb->lock);
+    gdb->running = false;
+    gdb->stop_signal = signal;
+    pthread_mutex_unlock(&gdb->lock);
+
+    // Wake the server thread so it sends the stop reply
+    if (write(gdb->wake_pipe[1], "s", 1) < 0) {
+      perror("gdb wake");
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Cpu Cpu;
+typedef struct Breakpoints Breakpoints;
+
+// GDB remote serial protocol stub.
+//
+// Packets are handled on a server thread. The emulation thread only looks at
+// an atomic flag while running, and hands the core over to the server thread
+// while stopped.
+//
+// Register layout for g/G/p/P: A, X, Y, P, SP (one byte each), PC (two bytes,
+// little endian).
+typedef struct GdbServer {
+  Cpu* cpu;
+  Breakpoints* breakpoints;
+
+  int listen_fd;
+  int client_fd;
+
+  // Written by the emulation thread whenever it stops
+  int wake_pipe[2];
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  // Protected by lock
+  bool running;
+  bool stepping;
+  bool quit;
+  int stop_signal;
+
+  // Set by the server thread to interrupt a running core
+  atomic_bool interrupt;
+} GdbServer;
+
+bool gdb_start(GdbServer* gdb, Cpu* cpu, Breakpoints* breakpoints, int port);
+
+// Runs the core on the calling thread until the debugger kills it
+void gdb_run(GdbServer* gdb);
@@ -0,0 +1,682 @@
+#include "lanes.h"
+#include "bus.h"
+#include "cpu.h"
+#include <string.h>
+
+// clang-format off
+static const uint8_t FLAG_STATUS_NEGATIVE          = 0b10000000;
+static const uint8_t FLAG_STATUS_OVERFLOW          = 0b01000000;
+static const uint8_t FLAG_STATUS_DECIMAL           = 0b00001000;
+static const uint8_t FLAG_STATUS_INTERRUPT_DISABLE = 0b00000100;
+static const uint8_t FLAG_STATUS_ZERO              = 0b00000010;
+static const uint8_t FLAG_STATUS_CARRY             = 0b00000001;
+// clang-format on
+
+static const uint16_t STACK_START = 0x0100;
+
+// The most cycles an instruction run in a batch takes. A lane closer than
+// that to its next event runs alone, so the event is handled after the
+// same instruction as in cpu_run.
+#define BATCH_MAX_CYCLES 7
+
+void lanes_init(Lanes* lanes, Emulator** emus, int count) {
+  *lanes = (Lanes){.count = count};
+  for (int i = 0; i < count; i++) {
+    lanes->emus[i] = emus[i];
+  }
+}
+
+static void load_lane(Lanes* lanes, int i) {
+  Cpu* cpu = &lanes->emus[i]->cpu;
+  lanes->a[i] = cpu->a;
+  lanes->x[i] = cpu->x;
+  lanes->y[i] = cpu->y;
+  lanes->status[i] = cpu->status;
+  lanes->sp[i] = cpu->sp;
+  lanes->pc[i] = cpu->pc;
+  lanes->cycles[i] = cpu->cycles_total;
+
+  lanes->next_event[i] = cpu->bus->next_event;
+  lanes->irq_line[i] = cpu->irq_line;
+  lanes->blocked[i] = cpu->nmi_pending || cpu->cycles_remaining ||
+                      cpu->trace || cpu->cycle_accurate;
+}
+
+static void store_lane(Lanes* lanes, int i) {
+  Cpu* cpu = &lanes->emus[i]->cpu;
+  cpu->a = lanes->a[i];
+  cpu->x = lanes->x[i];
+  cpu->y = lanes->y[i];
+  cpu->status = lanes->status[i];
+  cpu->sp = lanes->sp[i];
+  cpu->pc = lanes->pc[i];
+  cpu->cycles_total = lanes->cycles[i];
+}
+
+static void run_alone(Lanes* lanes, int i) {
+  store_lane(lanes, i);
+  Cpu* cpu = &lanes->emus[i]->cpu;
+  cpu_run(cpu, cpu->cycles_total + 1);
+  load_lane(lanes, i);
+  lanes->alone++;
+}
+
+static bool can_batch(const Lanes* lanes, int i) {
+  bool irq = lanes->irq_line[i] &&
+             !(lanes->status[i] & FLAG_STATUS_INTERRUPT_DISABLE);
+
+  // Operands past $FFFF would wrap around into RAM
+  return !lanes->blocked[i] && !irq &&
+         lanes->cycles[i] + BATCH_MAX_CYCLES < lanes->next_event[i] &&
+         lanes->pc[i] >= 0x8000 && lanes->pc[i] <= 0xFFFD;
+}
+
+// === Memory ==
+
+// Reads without side effects, false for I/O registers
+static bool lane_read(Lanes* lanes, int i, uint16_t addr, uint8_t* val) {
+  Bus* bus = &lanes->emus[i]->bus;
+  if (addr <= 0x1FFF) {
+    *val = bus->cpu_ram[addr % CPU_RAM_SIZE];
+    return true;
+  }
+
+  if (addr >= 0x4020) {
+    *val = cartridge_read(bus, addr);
+    return true;
+  }
+
+  return false;
+}
+
+static bool lane_writable(uint16_t addr) {
+  return addr <= 0x1FFF || (addr >= 0x6000 && addr <= 0x7FFF);
+}
+
+static void lane_write(Lanes* lanes, int i, uint16_t addr, uint8_t val) {
+  Bus* bus = &lanes->emus[i]->bus;
+  if (addr <= 0x1FFF) {
+    bus->cpu_ram[addr % CPU_RAM_SIZE] = val;
+  } else {
+    bus->prg_ram[addr - 0x6000] = val;
+  }
+}
+
+static void stack_push(Lanes* lanes, int i, uint8_t val) {
+  lanes->emus[i]->bus.cpu_ram[STACK_START + lanes->sp[i]--] = val;
+}
+
+static uint8_t stack_pop(Lanes* lanes, int i) {
+  return lanes->emus[i]->bus.cpu_ram[STACK_START + ++lanes->sp[i]];
+}
+
+static bool pages_differ(uint16_t one, uint16_t two) {
+  return (one & 0xFF00) != (two & 0xFF00);
+}
+
+// Zero page pointers are always in RAM, so no mode needs to fall back
+static uint16_t lane_address(Lanes* lanes, int i, AddressingMode mode,
+                             uint16_t operand, uint8_t* crossed) {
+  const uint8_t* ram = lanes->emus[i]->bus.cpu_ram;
+  uint8_t zp = (uint8_t)operand;
+  uint16_t base = operand;
+
+  switch (mode) {
+    case ZeroPage:
+      return zp;
+    case ZeroPageX:
+      return (uint8_t)(zp + lanes->x[i]);
+    case ZeroPageY:
+      return (uint8_t)(zp + lanes->y[i]);
+    case Absolute:
+      return operand;
+    case AbsoluteX:
+      *crossed = pages_differ(base, (uint16_t)(base + lanes->x[i]));
+      return (uint16_t)(base + lanes->x[i]);
+    case AbsoluteY:
+      *crossed = pages_differ(base, (uint16_t)(base + lanes->y[i]));
+      return (uint16_t)(base + lanes->y[i]);
+    case IndirectX: {
+      uint8_t ptr = (uint8_t)(zp + lanes->x[i]);
+      return (uint16_t)(ram[(uint8_t)(ptr + 1)] << 8 | ram[ptr]);
+    }
+    case IndirectY:
+      base = (uint16_t)(ram[(uint8_t)(zp + 1)] << 8 | ram[zp]);
+      *crossed = pages_differ(base, (uint16_t)(base + lanes->y[i]));
+      return (uint16_t)(base + lanes->y[i]);
+    default:
+      return 0;
+  }
+}
+
+// === Instructions ==
+//
+// Each runs over every lane and keeps the result only where mask is set,
+// with no branches in the loops so they compile to vector code
+
+typedef enum LaneAccess {
+  LaneNone,
+  LaneRead,
+  LaneWrite,
+  LaneModify
+} LaneAccess;
+
+static bool batchable(InstructionName name, AddressingMode mode) {
+  switch (name) {
+    case NameJMP:
+    case NameJSR:
+      return mode == Absolute;
+    // clang-format off
+    case NameADC: case NameAND: case NameASL: case NameBCC: case NameBCS:
+    case NameBEQ: case NameBIT: case NameBMI: case NameBNE: case NameBPL:
+    case NameBVC: case NameBVS: case NameCLC: case NameCLD: case NameCLI:
+    case NameCLV: case NameCMP: case NameCPX: case NameCPY: case NameDEC:
+    case NameDEX: case NameDEY: case NameEOR: case NameINC: case NameINX:
+    case NameINY: case NameLDA: case NameLDX: case NameLDY: case NameLSR:
+    case NameNOP: case NameORA: case NamePHA: case NamePHP: case NamePLA:
+    case NamePLP: case NameROL: case NameROR: case NameRTS: case NameSBC:
+    case NameSEC: case NameSED: case NameSEI: case NameSTA: case NameSTX:
+    case NameSTY: case NameTAX: case NameTAY: case NameTSX: case NameTXA:
+    case NameTXS: case NameTYA:
+    // clang-format on
+      return true;
+    default:
+      return false;
+  }
+}
+
+static LaneAccess lane_access(InstructionName name, AddressingMode mode) {
+  if (mode == Implied || mode == Accumulator || mode == Immediate ||
+      mode == Relative || name == NameJMP || name == NameJSR) {
+    return LaneNone;
+  }
+
+  switch (name) {
+    case NameSTA:
+    case NameSTX:
+    case NameSTY:
+      return LaneWrite;
+    case NameASL:
+    case NameLSR:
+    case NameROL:
+    case NameROR:
+    case NameINC:
+    case NameDEC:
+      return LaneModify;
+    default:
+      return LaneRead;
+  }
+}
+
+static void blend(uint8_t* reg, const uint8_t* mask, const uint8_t* val,
+                  int count) {
+  for (int i = 0; i < count; i++) {
+    reg[i] = mask[i] ? val[i] : reg[i];
+  }
+}
+
+static void set_negative_and_zero(Lanes* lanes, const uint8_t* mask,
+                                  const uint8_t* val) {
+  uint8_t clear = (uint8_t)~(FLAG_STATUS_NEGATIVE | FLAG_STATUS_ZERO);
+  for (int i = 0; i < lanes->count; i++) {
+    uint8_t flags = (uint8_t)((val[i] & FLAG_STATUS_NEGATIVE) |
+                              (val[i] ? 0 : FLAG_STATUS_ZERO));
+    uint8_t status = (uint8_t)((lanes->status[i] & clear) | flags);
+    lanes->status[i] = mask[i] ? status : lanes->status[i];
+  }
+}
+
+// Sets flag where on is 1 and clears it where on is 0
+static void set_flag_lanes(Lanes* lanes, const uint8_t* mask, uint8_t flag,
+                           const uint8_t* on) {
+  for (int i = 0; i < lanes->count; i++) {
+    uint8_t status =
+        (uint8_t)((lanes->status[i] & ~flag) | (on[i] ? flag : 0));
+    lanes->status[i] = mask[i] ? status : lanes->status[i];
+  }
+}
+
+static void set_flag_all(Lanes* lanes, const uint8_t* mask, uint8_t flag,
+                         bool on) {
+  for (int i = 0; i < lanes->count; i++) {
+    uint8_t status = (uint8_t)((lanes->status[i] & ~flag) | (on ? flag : 0));
+    lanes->status[i] = mask[i] ? status : lanes->status[i];
+  }
+}
+
+static void adc(Lanes* lanes, const uint8_t* mask, const uint8_t* val,
+                bool subtract) {
+  uint8_t sum[LANES_MAX];
+  uint8_t carry[LANES_MAX];
+  uint8_t overflow[LANES_MAX];
+  for (int i = 0; i < lanes->count; i++) {
+    uint8_t v = subtract ? (uint8_t)~val[i] : val[i];
+    int result = lanes->a[i] + v + (lanes->status[i] & FLAG_STATUS_CARRY);
+    sum[i] = (uint8_t)result;
+    carry[i] = result > 255;
+    overflow[i] = ((lanes->a[i] ^ sum[i]) & (v ^ sum[i]) & 0x80) != 0;
+  }
+
+  set_flag_lanes(lanes, mask, FLAG_STATUS_OVERFLOW, overflow);
+  set_flag_lanes(lanes, mask, FLAG_STATUS_CARRY, carry);
+  blend(lanes->a, mask, sum, lanes->count);
+  set_negative_and_zero(lanes, mask, sum);
+}
+
+static void compare(Lanes* lanes, const uint8_t* mask, const uint8_t* reg,
+                    const uint8_t* val) {
+  uint8_t diff[LANES_MAX];
+  uint8_t carry[LANES_MAX];
+  for (int i = 0; i < lanes->count; i++) {
+    diff[i] = (uint8_t)(reg[i] - val[i]);
+    carry[i] = reg[i] >= val[i];
+  }
+
+  set_flag_lanes(lanes, mask, FLAG_STATUS_CARRY, carry);
+  set_negative_and_zero(lanes, mask, diff);
+}
+
+// ASL, LSR, ROL and ROR of val into result
+static void shift(Lanes* lanes, const uint8_t* mask, InstructionName name,
+                  const uint8_t* val, uint8_t* result) {
+  bool left = name == NameASL || name == NameROL;
+  bool rotate = name == NameROL || name == NameROR;
+
+  uint8_t carry[LANES_MAX];
+  for (int i = 0; i < lanes->count; i++) {
+    uint8_t in = rotate ? lanes->status[i] & FLAG_STATUS_CARRY : 0;
+    if (left) {
+      carry[i] = val[i] >> 7;
+      result[i] = (uint8_t)(val[i] << 1 | in);
+    } else {
+      carry[i] = val[i] & 1;
+      result[i] = (uint8_t)(val[i] >> 1 | in << 7);
+    }
+  }
+
+  set_flag_lanes(lanes, mask, FLAG_STATUS_CARRY, carry);
+  set_negative_and_zero(lanes, mask, result);
+}
+
+static uint8_t branch_flag(InstructionName name) {
+  switch (name) {
+    case NameBPL:
+    case NameBMI:
+      return FLAG_STATUS_NEGATIVE;
+    case NameBVC:
+    case NameBVS:
+      return FLAG_STATUS_OVERFLOW;
+    case NameBCC:
+    case NameBCS:
+      return FLAG_STATUS_CARRY;
+    default:
+      return FLAG_STATUS_ZERO;
+  }
+}
+
+// Register and flag work of everything but stack and control flow, val
+// holds what was read and out gets what is written back
+static void execute(Lanes* lanes, const uint8_t* mask, InstructionName name,
+                    AddressingMode mode, const uint8_t* val, uint8_t* out) {
+  int count = lanes->count;
+  uint8_t result[LANES_MAX];
+
+  switch (name) {
+    case NameLDA:
+      blend(lanes->a, mask, val, count);
+      set_negative_and_zero(lanes, mask, val);
+      break;
+    case NameLDX:
+      blend(lanes->x, mask, val, count);
+      set_negative_and_zero(lanes, mask, val);
+      break;
+    case NameLDY:
+      blend(lanes->y, mask, val, count);
+      set_negative_and_zero(lanes, mask, val);
+      break;
+    case NameSTA:
+      blend(out, mask, lanes->a, count);
+      break;
+    case NameSTX:
+      blend(out, mask, lanes->x, count);
+      break;
+    case NameSTY:
+      blend(out, mask, lanes->y, count);
+      break;
+    case NameADC:
+    case NameSBC:
+      adc(lanes, mask, val, name == NameSBC);
+      break;
+    case NameAND:
+    case NameORA:
+    case NameEOR:
+      for (int i = 0; i < count; i++) {
+        uint8_t a = lanes->a[i];
+        result[i] = name == NameAND   ? a & val[i]
+                    : name == NameORA ? a | val[i]
+                                      : a ^ val[i];
+      }
+      blend(lanes->a, mask, result, count);
+      set_negative_and_zero(lanes, mask, result);
+      break;
+    case NameCMP:
+      compare(lanes, mask, lanes->a, val);
+      break;
+    case NameCPX:
+      compare(lanes, mask, lanes->x, val);
+      break;
+    case NameCPY:
+      compare(lanes, mask, lanes->y, val);
+      break;
+    case NameBIT:
+      for (int i = 0; i < count; i++) {
+        result[i] = (lanes->a[i] & val[i]) == 0;
+      }
+      set_flag_lanes(lanes, mask, FLAG_STATUS_ZERO, result);
+      for (int i = 0; i < count; i++) {
+        uint8_t flags = FLAG_STATUS_NEGATIVE | FLAG_STATUS_OVERFLOW;
+        uint8_t status =
+            (uint8_t)((lanes->status[i] & ~flags) | (val[i] & flags));
+        lanes->status[i] = mask[i] ? status : lanes->status[i];
+      }
+      break;
+    case NameINC:
+    case NameDEC:
+      for (int i = 0; i < count; i++) {
+        out[i] = (uint8_t)(val[i] + (name == NameINC ? 1 : -1));
+      }
+      set_negative_and_zero(lanes, mask, out);
+      break;
+    case NameASL:
+    case NameLSR:
+    case NameROL:
+    case NameROR:
+      if (mode == Accumulator) {
+        shift(lanes, mask, name, lanes->a, result);
+        blend(lanes->a, mask, result, count);
+      } else {
+        shift(lanes, mask, name, val, out);
+      }
+      break;
+    case NameINX:
+    case NameDEX:
+      for (int i = 0; i < count; i++) {
+        result[i] = (uint8_t)(lanes->x[i] + (name == NameINX ? 1 : -1));
+      }
+      blend(lanes->x, mask, result, count);
+      set_negative_and_zero(lanes, mask, result);
+      break;
+    case NameINY:
+    case NameDEY:
+      for (int i = 0; i < count; i++) {
+        result[i] = (uint8_t)(lanes->y[i] + (name == NameINY ? 1 : -1));
+      }
+      blend(lanes->y, mask, result, count);
+      set_negative_and_zero(lanes, mask, result);
+      break;
+    case NameTAX:
+      blend(lanes->x, mask, lanes->a, count);
+      set_negative_and_zero(lanes, mask, lanes->a);
+      break;
+    case NameTAY:
+      blend(lanes->y, mask, lanes->a, count);
+      set_negative_and_zero(lanes, mask, lanes->a);
+      break;
+    case NameTXA:
+      blend(lanes->a, mask, lanes->x, count);
+      set_negative_and_zero(lanes, mask, lanes->x);
+      break;
+    case NameTYA:
+      blend(lanes->a, mask, lanes->y, count);
+      set_negative_and_zero(lanes, mask, lanes->y);
+      break;
+    case NameTSX:
+      blend(lanes->x, mask, lanes->sp, count);
+      set_negative_and_zero(lanes, mask, lanes->sp);
+      break;
+    case NameTXS:
+      blend(lanes->sp, mask, lanes->x, count);
+      break;
+    case NameCLC:
+    case NameSEC:
+      set_flag_all(lanes, mask, FLAG_STATUS_CARRY, name == NameSEC);
+      break;
+    case NameCLI:
+    case NameSEI:
+      set_flag_all(lanes, mask, FLAG_STATUS_INTERRUPT_DISABLE,
+                   name == NameSEI);
+      break;
+    case NameCLD:
+    case NameSED:
+      set_flag_all(lanes, mask, FLAG_STATUS_DECIMAL, name == NameSED);
+      break;
+    case NameCLV:
+      set_flag_all(lanes, mask, FLAG_STATUS_OVERFLOW, false);
+      break;
+    default:
+      break;
+  }
+}
+
+// Stack, jumps and branches, which set next_pc and may add cycles
+static void control(Lanes* lanes, const uint8_t* mask, InstructionName name,
+                    uint16_t pc, uint16_t operand, uint16_t* next_pc,
+                    int* cycles) {
+  for (int i = 0; i < lanes->count; i++) {
+    if (!mask[i]) {
+      continue;
+    }
+
+    switch (name) {
+      case NamePHA:
+        stack_push(lanes, i, lanes->a[i]);
+        break;
+      case NamePHP:
+        stack_push(lanes, i, lanes->status[i] | 0b00110000);
+        break;
+      case NamePLA:
+        lanes->a[i] = stack_pop(lanes, i);
+        break;
+      case NamePLP:
+        lanes->status[i] = (uint8_t)((lanes->status[i] & ~0xCF) |
+                                     (stack_pop(lanes, i) & 0xCF));
+        break;
+      case NameJSR: {
+        uint16_t ret = (uint16_t)(pc + 2);
+        stack_push(lanes, i, ret >> 8);
+        stack_push(lanes, i, ret & 0xFF);
+        next_pc[i] = operand;
+        break;
+      }
+      case NameRTS: {
+        uint8_t lo = stack_pop(lanes, i);
+        uint8_t hi = stack_pop(lanes, i);
+        next_pc[i] = (uint16_t)((hi << 8 | lo) + 1);
+        break;
+      }
+      case NameJMP:
+        next_pc[i] = operand;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (name == NamePLA) {
+    set_negative_and_zero(lanes, mask, lanes->a);
+  }
+
+  bool branch = name == NameBPL || name == NameBMI || name == NameBVC ||
+                name == NameBVS || name == NameBCC || name == NameBCS ||
+                name == NameBNE || name == NameBEQ;
+  if (!branch) {
+    return;
+  }
+
+  // BMI, BVS, BCS and BEQ branch when their flag is set
+  uint8_t flag = branch_flag(name);
+  bool when_set = name == NameBMI || name == NameBVS || name == NameBCS ||
+                  name == NameBEQ;
+  uint16_t next = (uint16_t)(pc + 2);
+  uint16_t target = (uint16_t)(next + (int8_t)operand);
+  int taken_cycles = 1 + pages_differ(next, target);
+
+  for (int i = 0; i < lanes->count; i++) {
+    bool taken = mask[i] && ((lanes->status[i] & flag) != 0) == when_set;
+    next_pc[i] = taken ? target : next_pc[i];
+    cycles[i] += taken ? taken_cycles : 0;
+  }
+}
+
+// Reads the instruction bytes at pc as lane i sees them
+static void fetch(Lanes* lanes, int i, uint16_t pc, uint8_t* bytes) {
+  Bus* bus = &lanes->emus[i]->bus;
+  for (int j = 0; j < 3; j++) {
+    bytes[j] = cartridge_read(bus, (uint16_t)(pc + j));
+  }
+}
+
+// Runs the instruction the leader has at pc for every lane in mask. Lanes
+// with other code banked in or patched over pc are left for a later batch,
+// lanes that turn out to access I/O run alone instead. False if the
+// instruction can't be batched at all.
+static bool run_batch(Lanes* lanes, int leader, uint16_t pc, uint8_t* mask) {
+  int count = lanes->count;
+
+  uint8_t bytes[3];
+  fetch(lanes, leader, pc, bytes);
+  uint8_t opcode = bytes[0];
+  InstructionName name = (InstructionName)OPCODES[opcode][0];
+  AddressingMode mode = (AddressingMode)OPCODES[opcode][2];
+  if (!batchable(name, mode)) {
+    return false;
+  }
+
+  int length = OPCODES[opcode][1];
+  uint16_t operand = bytes[1];
+  if (length == 3) {
+    operand |= (uint16_t)(bytes[2] << 8);
+  }
+
+  // Lanes with the leader's banks and cheats read the same bytes
+  const Bus* lead = &lanes->emus[leader]->bus;
+  for (int i = 0; i < count; i++) {
+    const Bus* bus = &lanes->emus[i]->bus;
+    if (!mask[i] || (bus->cheats == lead->cheats &&
+                     !memcmp(bus->prg_banks, lead->prg_banks,
+                             sizeof(bus->prg_banks)))) {
+      continue;
+    }
+
+    uint8_t lane_bytes[3];
+    fetch(lanes, i, pc, lane_bytes);
+    mask[i] = !memcmp(lane_bytes, bytes, (size_t)length);
+  }
+
+  LaneAccess access = lane_access(name, mode);
+  uint16_t addr[LANES_MAX];
+  uint8_t crossed[LANES_MAX];
+  uint8_t val[LANES_MAX];
+  uint8_t out[LANES_MAX];
+  bool alone[LANES_MAX];
+
+  for (int i = 0; i < count; i++) {
+    addr[i] = 0;
+    crossed[i] = 0;
+    val[i] = mode == Immediate ? (uint8_t)operand : 0;
+    out[i] = 0;
+    alone[i] = false;
+    if (!mask[i] || access == LaneNone) {
+      continue;
+    }
+
+    addr[i] = lane_address(lanes, i, mode, operand, &crossed[i]);
+    bool ok = access == LaneWrite || lane_read(lanes, i, addr[i], &val[i]);
+    if (access != LaneRead) {
+      ok = ok && lane_writable(addr[i]);
+    }
+
+    if (!ok) {
+      mask[i] = 0;
+      alone[i] = true;
+    }
+  }
+
+  execute(lanes, mask, name, mode, val, out);
+
+  uint16_t next_pc[LANES_MAX];
+  int cycles[LANES_MAX];
+  int page_penalty = OPCODES[opcode][4];
+  for (int i = 0; i < count; i++) {
+    next_pc[i] = (uint16_t)(pc + length);
+    cycles[i] = OPCODES[opcode][3] + (crossed[i] & page_penalty);
+  }
+  control(lanes, mask, name, pc, operand, next_pc, cycles);
+
+  long batched = 0;
+  for (int i = 0; i < count; i++) {
+    if (!mask[i]) {
+      continue;
+    }
+
+    if (access == LaneWrite || access == LaneModify) {
+      lane_write(lanes, i, addr[i], out[i]);
+    }
+    lanes->pc[i] = next_pc[i];
+    lanes->cycles[i] += cycles[i];
+    batched++;
+  }
+
+  if (batched) {
+    lanes->batched += batched;
+    lanes->batches++;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (alone[i]) {
+      run_alone(lanes, i);
+    }
+  }
+  return true;
+}
+
+void lanes_run(Lanes* lanes, long until) {
+  for (int i = 0; i < lanes->count; i++) {
+    load_lane(lanes, i);
+  }
+
+  for (;;) {
+    // The lane furthest behind leads, so lanes that went different ways
+    // get a chance to meet again
+    int leader = -1;
+    for (int i = 0; i < lanes->count; i++) {
+      if (lanes->cycles[i] < until &&
+          (leader < 0 || lanes->cycles[i] < lanes->cycles[leader])) {
+        leader = i;
+      }
+    }
+    if (leader < 0) {
+      break;
+    }
+
+    if (!can_batch(lanes, leader)) {
+      run_alone(lanes, leader);
+      continue;
+    }
+
+    uint16_t pc = lanes->pc[leader];
+    uint8_t mask[LANES_MAX];
+    for (int i = 0; i < lanes->count; i++) {
+      mask[i] = lanes->cycles[i] < until && lanes->pc[i] == pc &&
+                can_batch(lanes, i);
+    }
+
+    if (!run_batch(lanes, leader, pc, mask)) {
+      run_alone(lanes, leader);
+    }
+  }
+
+  for (int i = 0; i < lanes->count; i++) {
+    store_lane(lanes, i);
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "emulator.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LANES_MAX 64
+
+// Emulators of one ROM stepped together, for searches and fuzzing that run
+// many copies from slightly different states. Lanes at the same PC in ROM,
+// with the same bytes banked in there, run the instruction as one batch
+// over the register arrays. A lane that touches I/O, runs from RAM, or has
+// an interrupt or event coming up runs that instruction through cpu_run on
+// its own. Breakpoints are not supported.
+typedef struct Lanes {
+  int count;
+  Emulator* emus[LANES_MAX];
+
+  // One entry per lane. The lanes' Cpus are only current outside of
+  // lanes_run.
+  uint8_t a[LANES_MAX];
+  uint8_t x[LANES_MAX];
+  uint8_t y[LANES_MAX];
+  uint8_t status[LANES_MAX];
+  uint8_t sp[LANES_MAX];
+  uint16_t pc[LANES_MAX];
+  long cycles[LANES_MAX];
+
+  // Taken from each lane's Cpu and bus whenever it runs on its own, batches
+  // never change them
+  long next_event[LANES_MAX];
+  bool irq_line[LANES_MAX];
+  // Has cycles or an NMI pending, or wants to see every instruction
+  bool blocked[LANES_MAX];
+
+  // Lane instructions run in batches, over this many batches
+  long batched;
+  long batches;
+  // Lane instructions run on their own
+  long alone;
+} Lanes;
+
+// The emulators must all run the same ROM, count is at most LANES_MAX
+void lanes_init(Lanes* lanes, Emulator** emus, int count);
+// Runs every lane until its cycles_total reaches until, like cpu_run
+void lanes_run(Lanes* lanes, long until);
@@ -1,17 +1,654 @@
-
+#include "breakpoint.h"
 #include "bus.h"
+#include "capture.h"
+#include "cheats.h"
+#include "coverage.h"
 #include "cpu.h"
+#include "debug.h"
+#include "disasm.h"
+#include "emulator.h"
+#include "framehash.h"
+#include "framequeue.h"
+#include "gdb.h"
+#include "lanes.h"
+#include "movie.h"
+#include "nsf.h"
+#include "pace.h"
+#include "perf.h"
+#include "present.h"
+#include "stats.h"
+#include <inttypes.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void print_usage(const char* program) {
+  printf("Syntax: %s [options] <ines rom file>\n", program);
+  printf("        %s [-t TRACK] [-l SECONDS] -a FILE <nsf file>\n", program);
+  printf("        %s [-l SECONDS] [-a DIR] <directory of nsf files>\n",
+         program);
+  printf("  -b ADDR              break when the PC reaches ADDR\n");
+  printf("  -r ADDR[-END][=VAL]  break on reads of ADDR..END (of VAL)\n");
+  printf("  -w ADDR[-END][=VAL]  break on writes to ADDR..END (of VAL)\n");
+  printf("  -c CYCLES            break once CYCLES cycles have run\n");
+  printf("  -g PORT              wait for gdb on localhost:PORT\n");
+  printf("  -G CODE              apply a Game Genie code, AAAA:VV or AAAA?CC:VV\n");
+  printf("                       (RAM below $0800 is frozen)\n");
+  printf("  -m MOVIE             play back MOVIE headless and check its hash\n");
+  printf("  -o MOVIE             save the played back movie with its hash\n");
+  printf("  -H                   run headless as fast as possible\n");
+  printf("  -f FRAMES            stop after FRAMES frames\n");
+  printf("  -s SECONDS           report emulation speed every SECONDS\n");
+  printf("  -i                   run in real time until interrupted\n");
+  printf("  -v FILE              with -i, stream raw frames to FILE\n");
+  printf("  -y FILE              with -H or -m, capture video to FILE (.y4m\n");
+  printf("                       or raw RGB24)\n");
+  printf("  -a FILE              with -H or -m, capture audio to FILE (.wav),\n");
+  printf("                       with an NSF render to FILE (.wav), with a\n");
+  printf("                       directory render every track into FILE\n");
+  printf("  -t TRACK             with an NSF, the track to render\n");
+  printf("  -l SECONDS           with NSFs, render SECONDS of each track\n");
+  printf("                       (default 120)\n");
+  printf("  -S FILE              with -H or -m, save opcode and bus access\n");
+  printf("                       counts to FILE (CSV, or JSON for .json)\n");
+  printf("  -V FILE              with -H or -m, record PRG ROM coverage into\n");
+  printf("                       FILE, merging with what it already holds\n");
+  printf("  -p                   with -H or -m, count host cycles, cache and\n");
+  printf("                       branch misses per emulated instruction\n");
+  printf("  -P                   with -y, draw frames on the emulation thread\n");
+  printf("                       instead of a pipeline thread\n");
+  printf("  -C                   use the cycle accurate CPU core, traces show\n");
+  printf("                       every bus access\n");
+  printf("  -I                   interpret idle loops instead of skipping to\n");
+  printf("                       the next event\n");
+  printf("  -L LANES             run LANES copies for -f FRAMES, batching\n");
+  printf("                       the instructions they run in lockstep\n");
+  printf("  -d                   disassemble the PRG ROM from its vectors\n");
+  printf("  -x MANIFEST          with -H or -m, check frame hashes in MANIFEST\n");
+  printf("  -X MANIFEST          with -H or -m, record frame hashes in MANIFEST\n");
+}
+
+// Parses "ADDR[-END][=VAL]" with hex numbers
+static bool parse_watchpoint(const char* arg, int kind, Watchpoint* watch) {
+  char* end;
+  *watch = (Watchpoint){.kind = kind};
+
+  watch->start = (uint16_t)strtoul(arg, &end, 16);
+  watch->end = watch->start;
+  if (end == arg) {
+    return false;
+  }
+
+  if (*end == '-') {
+    arg = end + 1;
+    watch->end = (uint16_t)strtoul(arg, &end, 16);
+    if (end == arg) {
+      return false;
+    }
+  }
+
+  if (*end == '=') {
+    arg = end + 1;
+    watch->has_value = true;
+    watch->value = (uint8_t)strtoul(arg, &end, 16);
+    if (end == arg) {
+      return false;
+    }
+  }
+
+  return *end == '\0';
+}
+
+// Prints every instruction reachable from the vectors, bank by bank, with
+// the gaps in between summarized as data
+static int print_disassembly(unsigned char* rom) {
+  Disassembly disasm;
+  if (!disasm_init(&disasm, rom)) {
+    return 1;
+  }
+
+  for (int bank = 0; bank < disasm.bank_count; bank++) {
+    const DisasmBank* result = disasm_bank(&disasm, bank);
+    uint16_t base = disasm_bank_base(&disasm, bank);
+    printf("; Bank %d at $%04X, %ld instructions\n", bank, base,
+           result->code_count);
+
+    long next = base;
+    for (long i = 0; i < result->code_count; i++) {
+      const Instruction* instr = &result->code[i];
+      if (instr->pc > next) {
+        printf("; $%04lX-$%04X data\n", next, instr->pc - 1);
+      }
+
+      char text[32];
+      disasm_format(instr, text, sizeof(text));
+      printf("%04X  %s\n", instr->pc, text);
+      next = instr->pc + instr->length;
+    }
+
+    if (next < base + 0x4000) {
+      printf("; $%04lX-$%04X data\n", next, base + 0x3FFF);
+    }
+  }
+
+  disasm_free(&disasm);
+  return 0;
+}
+
+static bool breakpoint_stopped(const Cpu* cpu) {
+  return cpu->bus->breakpoints && cpu->bus->breakpoints->stopped;
+}
+
+static void print_stop(Cpu* cpu) {
+  const Breakpoints* bp = cpu->bus->breakpoints;
+  printf("Stopped on %s at $%04X", break_reason_name(bp->reason),
+         bp->address);
+  if (bp->reason == BreakRead || bp->reason == BreakWrite) {
+    printf(" (value $%02X)", bp->value);
+  }
+  printf(" after %li cycles\n", cpu->cycles_total);
+  print_debug(cpu);
+}
+
+// Runs until the PPU enters vblank or a breakpoint stops the CPU
+static void run_frame(Cpu* cpu) {
+  Ppu* ppu = &cpu->bus->ppu;
+  // Vblank is always an event, so this stops right on it
+  while (!ppu->frame_complete && !breakpoint_stopped(cpu)) {
+    cpu_run(cpu, cpu->bus->next_event);
+  }
+  ppu->frame_complete = false;
+}
+
+static double elapsed_seconds(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_speed(long frames, long cycles, double seconds) {
+  printf("%ld frames, %.1f fps, %.3f MHz emulated\n", frames,
+         (double)frames / seconds, (double)cycles / seconds / 1e6);
+}
+
+static void print_events(const Scheduler* scheduler) {
+  if (!scheduler->frames) {
+    return;
+  }
+
+  printf("Events per frame:");
+  for (int i = 0; i < EVENT_KINDS; i++) {
+    printf(" %s %.1f (max %ld)", scheduler_event_name((EventKind)i),
+           (double)scheduler->fired[i] / (double)scheduler->frames,
+           scheduler->max_frame_fired[i]);
+  }
+  printf("\n");
+}
+
+// Renders and mixes straight into a capture slot, waiting for the writer
+// thread if it falls behind so no frame is lost. Without a capture only
+// frames needed for a screenshot are rendered.
+static void run_output_frame(Cpu* cpu, Capture* capture, bool screenshot) {
+  if (!capture) {
+    cpu->bus->ppu.render = screenshot;
+    run_frame(cpu);
+    return;
+  }
+
+  Ppu* ppu = &cpu->bus->ppu;
+  Apu* apu = &cpu->bus->apu;
+  FrameSlot* slot = capture_acquire(capture);
+
+  ppu->render = capture->video_fd >= 0 || screenshot;
+  ppu->framebuffer = slot->pixels;
+  if (capture->audio_fd >= 0) {
+    apu_set_output(apu, slot->audio, FRAME_AUDIO_SAMPLES);
+  }
+
+  run_frame(cpu);
+
+  slot->frame = ppu->frame;
+  slot->audio_count = apu->sample_count;
+  apu_set_output(apu, NULL, 0);
+  capture_publish(capture);
+}
+
+// Runs a frame, checking its screenshot if the manifest lists it
+static void run_checked_frame(Cpu* cpu, Capture* capture,
+                              FrameManifest* manifest) {
+  Ppu* ppu = &cpu->bus->ppu;
+  bool screenshot = manifest && manifest_wants(manifest, ppu->frame + 1);
+
+  run_output_frame(cpu, capture, screenshot);
+
+  if (screenshot) {
+    if (capture) {
+      capture_sync(capture);
+    }
+    manifest_check(manifest, ppu->frame, ppu->framebuffer);
+  }
+}
+
+// Runs unthrottled, reporting the speed every report_interval seconds. No
+// pixels or samples are produced unless they are being captured or checked.
+static int run_headless(Cpu* cpu, long frames, double report_interval,
+                        Capture* capture, FrameManifest* manifest) {
+  Ppu* ppu = &cpu->bus->ppu;
+  cpu_reset(cpu);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  double last_report = 0;
+  long last_frame = 0;
+  long last_cycles = 0;
+
+  while ((!frames || ppu->frame < frames) && !breakpoint_stopped(cpu)) {
+    run_checked_frame(cpu, capture, manifest);
+
+    double now = elapsed_seconds(&start);
+    if (now - last_report >= report_interval) {
+      print_speed(ppu->frame - last_frame, cpu->cycles_total - last_cycles,
+                  now - last_report);
+      last_report = now;
+      last_frame = ppu->frame;
+      last_cycles = cpu->cycles_total;
+    }
+  }
+
+  if (breakpoint_stopped(cpu)) {
+    print_stop(cpu);
+  }
+
+  printf("Total: ");
+  print_speed(ppu->frame, cpu->cycles_total, elapsed_seconds(&start));
+  print_events(&cpu->bus->scheduler);
+  if (cpu->cycles_total) {
+    printf("Idle loops skipped: %.1f%% of cycles\n",
+           100.0 * (double)cpu->idle_cycles / (double)cpu->cycles_total);
+  }
+  return 0;
+}
+
+static volatile sig_atomic_t interrupted = 0;
+
+// Every lane starts from power on, so they only go separate ways where
+// timing differs
+static int run_lanes(unsigned char* rom, int count, long frames) {
+  Emulator* emus[LANES_MAX];
+  for (int i = 0; i < count; i++) {
+    emus[i] = emu_create(rom);
+    if (!emus[i]) {
+      printf("Out of memory\n");
+      while (i--) {
+        emu_destroy(emus[i]);
+      }
+      return 1;
+    }
+    cpu_reset(&emus[i]->cpu);
+  }
+
+  Lanes lanes;
+  lanes_init(&lanes, emus, count);
+  Bus* first = &emus[0]->bus;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (first->ppu.frame < frames) {
+    lanes_run(&lanes, first->next_event);
+  }
+
+  long cycles = 0;
+  for (int i = 0; i < count; i++) {
+    cycles += emus[i]->cpu.cycles_total;
+  }
+
+  printf("Total: ");
+  print_speed(first->ppu.frame * count, cycles, elapsed_seconds(&start));
+  long instructions = lanes.batched + lanes.alone;
+  printf("Batched %.1f%% of instructions, %.1f lanes per batch\n",
+         100.0 * (double)lanes.batched / (double)instructions,
+         lanes.batches ? (double)lanes.batched / (double)lanes.batches : 0);
+
+  for (int i = 0; i < count; i++) {
+    emu_destroy(emus[i]);
+  }
+  return 0;
+}
+
+static void handle_interrupt(int signal) {
+  (void)signal;
+  interrupted = 1;
+}
+
+// Renders straight into a queue slot, or skips rendering when the queue is
+// full or there is nobody to show the frame to
+static void run_queued_frame(Cpu* cpu, FrameQueue* queue) {
+  Ppu* ppu = &cpu->bus->ppu;
+  FrameSlot* slot = queue ? frame_queue_acquire(queue) : NULL;
+
+  ppu->render = slot != NULL;
+  if (slot) {
+    ppu->framebuffer = slot->pixels;
+  }
+
+  run_frame(cpu);
+
+  if (slot) {
+    slot->frame = ppu->frame;
+    slot->audio_count = 0;
+    frame_queue_publish(queue);
+  }
+}
+
+// Runs at the NTSC frame rate until interrupted, then prints the frame
+// timing histograms. Frames go to a presentation thread when video_path is
+// set.
+static int run_realtime(Cpu* cpu, long frames, const char* video_path) {
+  Ppu* ppu = &cpu->bus->ppu;
+  cpu_reset(cpu);
+
+  signal(SIGINT, handle_interrupt);
+
+  FrameQueue queue;
+  Presenter presenter;
+  if (video_path) {
+    if (!frame_queue_init(&queue, 3) ||
+        !presenter_start(&presenter, &queue, video_path)) {
+      return 1;
+    }
+  }
+
+  Pacer pacer;
+  pacer_init(&pacer, NTSC_FRAME_RATE, 500000);
+
+  while (!interrupted && (!frames || ppu->frame < frames) &&
+         !breakpoint_stopped(cpu)) {
+    run_queued_frame(cpu, video_path ? &queue : NULL);
+    pacer_wait(&pacer);
+  }
+
+  if (breakpoint_stopped(cpu)) {
+    print_stop(cpu);
+  }
+  pacer_print_stats(&pacer);
+
+  if (video_path) {
+    presenter_stop(&presenter);
+    printf("%ld frames presented, %ld dropped, %ld duplicated\n",
+           presenter.presented, queue.dropped, queue.duplicated);
+    frame_queue_free(&queue);
+  }
+
+  return 0;
+}
+
+// Replays the movie as fast as possible, returns non-zero if the final state
+// doesn't match the hash stored in the movie
+static int play_movie(Cpu* cpu, const char* path, const char* out_path,
+                      Capture* capture, FrameManifest* manifest) {
+  Movie movie;
+  if (!movie_load(&movie, path)) {
+    printf("Could not read movie %s\n", path);
+    return 1;
+  }
+
+  Bus* bus = cpu->bus;
+  cpu_reset(cpu);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  long frame = 0;
+  for (; frame < movie.frame_count && !breakpoint_stopped(cpu); frame++) {
+    bus->controllers[0].buttons = movie.inputs[frame * 2];
+    bus->controllers[1].buttons = movie.inputs[frame * 2 + 1];
+    run_checked_frame(cpu, capture, manifest);
+  }
+
+  // A stopped movie never reaches its final state, so there is no hash to
+  // check or keep
+  if (breakpoint_stopped(cpu)) {
+    print_stop(cpu);
+    printf("Played %ld of %ld frames\n", frame, movie.frame_count);
+    movie_free(&movie);
+    return 0;
+  }
+
+  double seconds = elapsed_seconds(&start);
+  uint64_t hash = movie_state_hash(cpu);
+  printf("Played %ld frames in %.3fs (%.0f fps), state hash %016" PRIx64 "\n",
+         movie.frame_count, seconds, (double)movie.frame_count / seconds, hash);
+
+  int result = 0;
+  if (movie.has_hash && movie.hash != hash) {
+    printf("Hash mismatch, movie expects %016" PRIx64 "\n", movie.hash);
+    result = 2;
+  }
+
+  if (out_path) {
+    movie.has_hash = true;
+    movie.hash = hash;
+    if (!movie_save(&movie, out_path)) {
+      printf("Could not write movie %s\n", out_path);
+      result = 1;
+    }
+  }
+
+  movie_free(&movie);
+  return result;
+}
+
+static int finish(Emulator* emu, unsigned char* rom, int result) {
+  emu_destroy(emu);
+  free(rom);
+  return result;
+}
+
+// game.nes -> game.sav
+static void save_path(const char* rom_path, char* out, size_t size) {
+  snprintf(out, size, "%s", rom_path);
+
+  char* dot = strrchr(out, '.');
+  char* slash = strrchr(out, '/');
+  if (dot && (!slash || dot > slash)) {
+    *dot = '\0';
+  }
+
+  size_t length = strlen(out);
+  snprintf(out + length, size - length, ".sav");
+}
+
+// Renders one track of an NSF to a WAV file
+static int play_nsf(const unsigned char* data, long size, int track,
+                    double seconds, const char* path) {
+  if (!path) {
+    printf("NSFs need -a FILE to render to\n");
+    return 1;
+  }
+
+  Nsf nsf;
+  if (!nsf_load(&nsf, data, size)) {
+    printf("Not an NSF we can play\n");
+    return 1;
+  }
+
+  if (!track) {
+    track = nsf.first_song;
+  }
+  if (track < 1 || track > nsf.song_count) {
+    printf("No track %d, there are %d\n", track, nsf.song_count);
+    nsf_free(&nsf);
+    return 1;
+  }
+  printf("%s - %s (%s), track %d of %d\n", nsf.title, nsf.artist,
+         nsf.copyright, track, nsf.song_count);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bool ok = nsf_render(&nsf, track, seconds, path);
+  double elapsed = elapsed_seconds(&start);
+  if (ok) {
+    printf("Rendered %.0fs in %.2fs, %.0fx real time\n", seconds, elapsed,
+           elapsed > 0 ? seconds / elapsed : 0);
+  }
+
+  nsf_free(&nsf);
+  return ok ? 0 : 1;
+}
 
 int main(int argc, char** argv) {
-  if (argc != 2) {
-    printf("Syntax: %s <ines rom file>\n", argv[0]);
+  Breakpoints breakpoints;
+  Watchpoint watches[MAX_WATCHPOINTS];
+  int watch_count = 0;
+  uint16_t pc_breaks[64];
+  int pc_break_count = 0;
+  long cycle_break = -1;
+  int gdb_port = 0;
+  const char* movie_path = NULL;
+  const char* movie_out_path = NULL;
+  bool headless = false;
+  bool realtime = false;
+  const char* video_path = NULL;
+  const char* capture_video_path = NULL;
+  const char* capture_audio_path = NULL;
+  const char* manifest_path = NULL;
+  bool manifest_update = false;
+  bool disassemble = false;
+  bool cycle_accurate = false;
+  bool skip_idle = true;
+  bool pipelined = true;
+  bool count_perf = false;
+  const char* stats_path = NULL;
+  const char* coverage_path = NULL;
+  Cheats cheats = {0};
+  int lane_count = 0;
+  long frame_limit = 0;
+  double report_interval = 1;
+  int nsf_track = 0;
+  double nsf_seconds = 120;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:r:w:c:g:G:m:o:Hf:s:iv:y:a:x:X:dCIpPS:V:L:t:l:")) != -1) {
+    switch (opt) {
+      case 'b':
+        if (pc_break_count == 64) {
+          printf("Too many breakpoints\n");
+          return 1;
+        }
+        pc_breaks[pc_break_count++] = (uint16_t)strtoul(optarg, NULL, 16);
+        break;
+      case 'r':
+      case 'w':
+        if (watch_count == MAX_WATCHPOINTS ||
+            !parse_watchpoint(optarg, opt == 'r' ? WatchRead : WatchWrite,
+                              &watches[watch_count])) {
+          printf("Invalid watchpoint %s\n", optarg);
+          return 1;
+        }
+        watch_count++;
+        break;
+      case 'c':
+        cycle_break = strtol(optarg, NULL, 10);
+        break;
+      case 'g':
+        gdb_port = atoi(optarg);
+        break;
+      case 'G': {
+        Cheat cheat;
+        if (!cheat_parse(optarg, &cheat) || !cheats_add(&cheats, &cheat)) {
+          printf("Invalid cheat %s\n", optarg);
+          return 1;
+        }
+        break;
+      }
+      case 'm':
+        movie_path = optarg;
+        break;
+      case 'o':
+        movie_out_path = optarg;
+        break;
+      case 'H':
+        headless = true;
+        break;
+      case 'i':
+        realtime = true;
+        break;
+      case 'v':
+        video_path = optarg;
+        break;
+      case 'y':
+        capture_video_path = optarg;
+        break;
+      case 'a':
+        capture_audio_path = optarg;
+        break;
+      case 'd':
+        disassemble = true;
+        break;
+      case 'C':
+        cycle_accurate = true;
+        break;
+      case 'I':
+        skip_idle = false;
+        break;
+      case 'p':
+        count_perf = true;
+        break;
+      case 'S':
+        stats_path = optarg;
+        break;
+      case 'V':
+        coverage_path = optarg;
+        break;
+      case 'P':
+        pipelined = false;
+        break;
+      case 'L':
+        lane_count = atoi(optarg);
+        break;
+      case 'x':
+      case 'X':
+        manifest_path = optarg;
+        manifest_update = opt == 'X';
+        break;
+      case 'f':
+        frame_limit = strtol(optarg, NULL, 10);
+        break;
+      case 's':
+        report_interval = strtod(optarg, NULL);
+        break;
+      case 't':
+        nsf_track = (int)strtol(optarg, NULL, 10);
+        break;
+      case 'l':
+        nsf_seconds = strtod(optarg, NULL);
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
     return 1;
   }
 
-  char* filename = argv[1];
+  char* filename = argv[optind];
+
+  // A whole directory of NSFs, rendered next to them by default
+  struct stat file_stat;
+  if (stat(filename, &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+    const char* out_dir = capture_audio_path ? capture_audio_path : filename;
+    return nsf_render_dir(filename, out_dir, nsf_seconds) ? 0 : 1;
+  }
 
   FILE* file = fopen(filename, "rb");
   fseek(file, 0, SEEK_END);
@@ -22,16 +659,224 @@ int main(int argc, char** argv) {
   fread(rom, 1, rom_size, file);
   fclose(file);
 
+  if (rom_size > 5 && memcmp(rom, "NESM\x1a", 5) == 0) {
+    int result = play_nsf(rom, (long)rom_size, nsf_track, nsf_seconds,
+                          capture_audio_path);
+    free(rom);
+    return result;
+  }
+
   if (rom[0] != 'N' && rom[1] != 'E' && rom[2] != 'S' && rom[3] != 0x1A) {
     printf("Not an iNES file\n");
     return 1;
   }
 
-  Bus bus = bus_init(rom);
-  Cpu cpu = cpu_init(&bus);
-  bus.cpu = &cpu;
+  if (disassemble) {
+    int result = print_disassembly(rom);
+    free(rom);
+    return result;
+  }
+
+  if (lane_count) {
+    if (lane_count < 1 || lane_count > LANES_MAX || !frame_limit) {
+      printf("-L takes 1 to %d lanes and needs -f\n", LANES_MAX);
+      free(rom);
+      return 1;
+    }
+    // Lanes share one instruction stream, there is nowhere for one to stop
+    if (pc_break_count || watch_count || cycle_break >= 0) {
+      printf("-L can't be used with breakpoints\n");
+      free(rom);
+      return 1;
+    }
+
+    int result = run_lanes(rom, lane_count, frame_limit);
+    free(rom);
+    return result;
+  }
 
-  while (true) {
-    cpu_execute(&cpu);
+  Emulator* emu = emu_create(rom);
+  if (!emu) {
+    printf("Out of memory\n");
+    return 1;
   }
+  Cpu* cpu = &emu->cpu;
+
+  // Movies and manifests replay from cleared save RAM, whatever the last
+  // session left in the save file
+  if (!movie_path && !manifest_path) {
+    char path[4096];
+    save_path(filename, path, sizeof(path));
+    if (!bus_map_save(&emu->bus, path)) {
+      printf("Could not open save file %s, saves won't be kept\n", path);
+    }
+  }
+  if (cycle_accurate) {
+    cpu->cycle_accurate = true;
+  }
+  cpu->skip_idle = skip_idle;
+  if (cheats.count && !cheats_attach(&cheats, &emu->bus)) {
+    printf("ROM cheats only work on NROM games\n");
+    return finish(emu, rom, 1);
+  }
+
+  breakpoints_init(&breakpoints, &emu->bus);
+  for (int i = 0; i < pc_break_count; i++) {
+    breakpoint_add(&breakpoints, pc_breaks[i]);
+  }
+  for (int i = 0; i < watch_count; i++) {
+    watchpoint_add(&breakpoints, watches[i]);
+  }
+  breakpoint_set_cycle(&breakpoints, cycle_break);
+
+  if (movie_path || headless) {
+    Capture capture;
+    bool capturing = capture_video_path || capture_audio_path;
+    if (capturing &&
+        !capture_start(&capture, capture_video_path, capture_audio_path,
+                       pipelined ? &cpu->bus->ppu : NULL)) {
+      return finish(emu, rom, 1);
+    }
+
+    FrameManifest manifest;
+    if (manifest_path &&
+        !manifest_load(&manifest, manifest_path, manifest_update)) {
+      printf("Could not read manifest %s\n", manifest_path);
+      return finish(emu, rom, 1);
+    }
+
+    // Stop after the last screenshot unless told otherwise
+    if (manifest_path && !frame_limit) {
+      frame_limit = manifest_last_frame(&manifest);
+    }
+
+    Capture* capture_sink = capturing ? &capture : NULL;
+    FrameManifest* manifest_sink = manifest_path ? &manifest : NULL;
+
+    Stats stats = {0};
+    if (stats_path) {
+      emu->bus.stats = &stats;
+    }
+
+    Coverage coverage;
+    if (coverage_path) {
+      if (!coverage_init(&coverage, rom)) {
+        printf("Out of memory\n");
+        return finish(emu, rom, 1);
+      }
+      emu->bus.coverage = &coverage;
+    }
+
+    Perf perf;
+    bool counting = count_perf && perf_open(&perf);
+    if (count_perf && !counting) {
+      printf("No hardware counters available\n");
+    }
+    if (counting) {
+      perf_start(&perf);
+    }
+
+    int result =
+        movie_path ? play_movie(cpu, movie_path, movie_out_path,
+                                capture_sink, manifest_sink)
+                   : run_headless(cpu, frame_limit, report_interval,
+                                  capture_sink, manifest_sink);
+
+    if (counting) {
+      perf_stop(&perf);
+      perf_print(&perf, cpu->instructions);
+      perf_close(&perf);
+    }
+
+    if (stats_path) {
+      emu->bus.stats = NULL;
+      if (stats_save(&stats, stats_path)) {
+        printf("Saved statistics to %s\n", stats_path);
+      } else {
+        printf("Could not write statistics to %s\n", stats_path);
+        result = 1;
+      }
+    }
+
+    if (coverage_path) {
+      emu->bus.coverage = NULL;
+      if (!coverage_merge_file(&coverage, coverage_path)) {
+        printf("%s is not coverage of this ROM, not overwriting it\n",
+               coverage_path);
+        result = 1;
+      } else if (!coverage_save(&coverage, coverage_path)) {
+        printf("Could not write coverage to %s\n", coverage_path);
+        result = 1;
+      } else {
+        coverage_print(&coverage);
+      }
+      coverage_free(&coverage);
+    }
+
+    if (capturing) {
+      if (!capture_stop(&capture)) {
+        printf("Capture failed\n");
+        result = 1;
+      }
+      printf("Captured %ld frames, %ld audio samples, waited %ld times\n",
+             capture.frames, capture.audio_samples, capture.queue.waited);
+      if (pipelined && capture_video_path) {
+        printf("Waited for drawing %ld times\n", capture.draw_waited);
+      }
+    }
+
+    if (manifest_path) {
+      // Frames the run never reached
+      manifest.missing += manifest.count - manifest.next;
+      printf("Checked %ld frames, %ld mismatched, %ld missing\n",
+             manifest.next, manifest.mismatches, manifest.missing);
+
+      if (manifest_update && !manifest_save(&manifest)) {
+        printf("Could not write manifest %s\n", manifest_path);
+        result = 1;
+      } else if (!manifest_update && !result &&
+                 (manifest.mismatches || manifest.missing)) {
+        result = 2;
+      }
+      manifest_free(&manifest);
+    }
+
+    return finish(emu, rom, result);
+  }
+
+  if (realtime) {
+    return finish(emu, rom, run_realtime(cpu, frame_limit, video_path));
+  }
+
+  if (gdb_port) {
+    GdbServer gdb;
+    cpu_reset(cpu);
+    if (!gdb_start(&gdb, cpu, &breakpoints, gdb_port)) {
+      return finish(emu, rom, 1);
+    }
+
+    gdb_run(&gdb);
+    return finish(emu, rom, 0);
+  }
+
+  BusAccess accesses[16];
+  if (cpu->cycle_accurate) {
+    cpu->access_log = accesses;
+    cpu->access_log_size = 16;
+  }
+
+  cpu->trace = true;
+  while (!breakpoints.stopped) {
+    long seen = cpu->access_count;
+    cpu_execute(cpu);
+
+    for (long i = seen; i < cpu->access_count; i++) {
+      const BusAccess* access = &accesses[i % 16];
+      printf("      %ld %s $%04X = %02X\n", access->cycle,
+             access->write ? "W" : "R", access->addr, access->val);
+    }
+  }
+
+  print_stop(cpu);
+  return finish(emu, rom, 0);
 }
@@ -0,0 +1,113 @@
+#include "movie.h"
+#include "bus.h"
+#include "cpu.h"
+#include "util.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char BUTTON_NAMES[] = "RLDUTSBA";
+
+static uint8_t parse_buttons(const char* field) {
+  uint8_t buttons = 0;
+  for (int i = 0; i < 8 && field[i] && field[i] != '|'; i++) {
+    if (field[i] != '.' && field[i] != ' ') {
+      buttons |= (uint8_t)(0x80 >> i);
+    }
+  }
+
+  return buttons;
+}
+
+static void format_buttons(char* out, uint8_t buttons) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = buttons & (0x80 >> i) ? BUTTON_NAMES[i] : '.';
+  }
+}
+
+bool movie_record(Movie* movie, uint8_t port1, uint8_t port2) {
+  if (movie->frame_count == movie->capacity) {
+    long capacity = movie->capacity ? movie->capacity * 2 : 1024;
+    uint8_t* inputs = realloc(movie->inputs, (size_t)capacity * 2);
+    if (!inputs) {
+      return false;
+    }
+    movie->inputs = inputs;
+    movie->capacity = capacity;
+  }
+
+  movie->inputs[movie->frame_count * 2] = port1;
+  movie->inputs[movie->frame_count * 2 + 1] = port2;
+  movie->frame_count++;
+  return true;
+}
+
+bool movie_load(Movie* movie, const char* path) {
+  *movie = (Movie){0};
+
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+
+  char line[128];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '|') {
+      char* second = strchr(line + 1, '|');
+      uint8_t port2 = second && second[1] != '\n' && second[1] != '\0'
+                          ? parse_buttons(second + 1)
+                          : 0;
+      if (!movie_record(movie, parse_buttons(line + 1), port2)) {
+        fclose(file);
+        movie_free(movie);
+        return false;
+      }
+    } else if (strncmp(line, "hash ", 5) == 0) {
+      movie->has_hash = true;
+      movie->hash = strtoull(line + 5, NULL, 16);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+bool movie_save(const Movie* movie, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+
+  fprintf(file, "cnes-movie 1\n");
+  if (movie->has_hash) {
+    fprintf(file, "hash %016" PRIx64 "\n", movie->hash);
+  }
+
+  char line[] = "|........|........|\n";
+  for (long i = 0; i < movie->frame_count; i++) {
+    format_buttons(line + 1, movie->inputs[i * 2]);
+    format_buttons(line + 10, movie->inputs[i * 2 + 1]);
+    fputs(line, file);
+  }
+
+  fclose(file);
+  return true;
+}
+
+void movie_free(Movie* movie) {
+  free(movie->inputs);
+  *movie = (Movie){0};
+}
+
+uint64_t movie_state_hash(Cpu* cpu) {
+  uint8_t regs[] = {cpu->a,  cpu->x,         cpu->y, cpu->status,
+                    cpu->sp, cpu->pc & 0xFF, cpu->pc >> 8};
+
+  Ppu* ppu = &cpu->bus->ppu;
+  uint64_t hash = hash_fnv1a(FNV_OFFSET_BASIS, regs, sizeof(regs));
+  hash = hash_fnv1a(hash, cpu->bus->cpu_ram, 0x0800);
+  hash = hash_fnv1a(hash, ppu->vram, sizeof(ppu->vram));
+  hash = hash_fnv1a(hash, ppu->palette, sizeof(ppu->palette));
+  return hash_fnv1a(hash, ppu->oam, sizeof(ppu->oam));
+}
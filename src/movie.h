@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Cpu Cpu;
+
+// Input log, one entry per frame for both controller ports. There is no
+// input frontend to record from yet, so movies are written by hand or by
+// other tools.
+//
+// Stored as text, one frame per line in the same RLDUTSBA order FM2 uses:
+//   cnes-movie 1
+//   hash 0123456789abcdef
+//   |...U...A|........|
+typedef struct Movie {
+  // Two bytes per frame, port 1 then port 2
+  uint8_t* inputs;
+  long frame_count;
+  long capacity;
+
+  // State hash after the last frame
+  bool has_hash;
+  uint64_t hash;
+} Movie;
+
+bool movie_load(Movie* movie, const char* path);
+bool movie_save(const Movie* movie, const char* path);
+void movie_free(Movie* movie);
+
+// False if out of memory
+bool movie_record(Movie* movie, uint8_t port1, uint8_t port2);
+
+// Hash of everything a replay has to reproduce
+uint64_t movie_state_hash(Cpu* cpu);
@@ -0,0 +1,418 @@
+#include "nsf.h"
+#include "apu.h"
+#include "emulator.h"
+#include "wav.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CPU_CLOCK 1789773.0
+#define HEADER_SIZE 0x80
+#define BANK_SIZE 0x1000
+#define INES_BANK_SIZE 0x4000
+// Where INIT and PLAY return to. Nothing is mapped there, and it is never
+// executed, the player stops as soon as the PC gets there.
+#define RETURN_ADDR 0x4100
+// Samples per PLAY call are well under this even at the slowest speed
+#define CHUNK_SAMPLES 4096
+
+static void copy_text(char* out, const unsigned char* field) {
+  memcpy(out, field, 32);
+  out[32] = '\0';
+}
+
+bool nsf_load(Nsf* nsf, const unsigned char* data, long size) {
+  if (size <= HEADER_SIZE || memcmp(data, "NESM\x1a", 5)) {
+    return false;
+  }
+
+  *nsf = (Nsf){
+      .song_count = data[6],
+      .first_song = data[7] ? data[7] : 1,
+      .init_addr = (uint16_t)(data[0x0B] << 8 | data[0x0A]),
+      .play_addr = (uint16_t)(data[0x0D] << 8 | data[0x0C]),
+  };
+  uint16_t load_addr = (uint16_t)(data[0x09] << 8 | data[0x08]);
+  copy_text(nsf->title, data + 0x0E);
+  copy_text(nsf->artist, data + 0x2E);
+  copy_text(nsf->copyright, data + 0x4E);
+
+  // 0 is common in rips and means the usual 60 Hz
+  int speed = data[0x6F] << 8 | data[0x6E];
+  nsf->play_period = (speed ? speed : 16639) * CPU_CLOCK / 1000000;
+
+  // Tunes loaded below $8000 need RAM there, which mapper 31 doesn't have
+  if (load_addr < 0x8000 || !nsf->song_count) {
+    return false;
+  }
+
+  bool bankswitched = false;
+  for (int i = 0; i < 8; i++) {
+    bankswitched |= data[0x70 + i] != 0;
+  }
+
+  // Bankswitched data starts at the load address's offset in the first
+  // bank. Anything else lands at its address in a flat 32K.
+  long data_size = size - HEADER_SIZE;
+  long offset = load_addr & (BANK_SIZE - 1);
+  long prg_size = offset + data_size;
+  if (!bankswitched) {
+    offset = load_addr - 0x8000;
+    prg_size = 2 * INES_BANK_SIZE;
+    if (data_size > prg_size - offset) {
+      data_size = prg_size - offset;
+    }
+  }
+  long ines_banks = (prg_size + INES_BANK_SIZE - 1) / INES_BANK_SIZE;
+  if (ines_banks > 0xFF) {
+    return false;
+  }
+
+  nsf->rom = calloc(1, 0x10 + ines_banks * INES_BANK_SIZE);
+  if (!nsf->rom) {
+    return false;
+  }
+  memcpy(nsf->rom, "NES\x1a", 4);
+  nsf->rom[4] = (unsigned char)ines_banks;
+  // No CHR ROM, so the PPU gets CHR RAM and leaves the PRG alone
+  nsf->rom[5] = 0;
+  nsf->rom[6] = 0xF0;
+  nsf->rom[7] = 0x10;
+  memcpy(nsf->rom + 0x10 + offset, data + HEADER_SIZE, (size_t)data_size);
+
+  for (int i = 0; i < 8; i++) {
+    nsf->banks[i] = bankswitched ? data[0x70 + i] : (uint8_t)i;
+  }
+  return true;
+}
+
+void nsf_free(Nsf* nsf) {
+  free(nsf->rom);
+  nsf->rom = NULL;
+}
+
+// Sets up a JSR to addr from RETURN_ADDR
+static void call(Cpu* cpu, uint16_t addr, uint8_t a, uint8_t x) {
+  uint8_t* stack = cpu->bus->cpu_ram + 0x100;
+  uint16_t ret = RETURN_ADDR - 1;
+  stack[cpu->sp--] = (uint8_t)(ret >> 8);
+  stack[cpu->sp--] = (uint8_t)ret;
+
+  cpu->pc = addr;
+  cpu->a = a;
+  cpu->x = x;
+  cpu->y = 0;
+}
+
+// Runs the routine a call set up, one instruction at a time so the return is
+// caught, until it returns or cycles_total reaches until
+static bool finish_call(Cpu* cpu, long until) {
+  while (cpu->pc != RETURN_ADDR && cpu->cycles_total < until) {
+    cpu_run(cpu, cpu->cycles_total + 1);
+  }
+  return cpu->pc == RETURN_ADDR;
+}
+
+// What the player does between calls: nothing, while the APU plays on
+static void idle(Cpu* cpu, long until) {
+  if (cpu->cycles_total < until) {
+    cpu->cycles_remaining = (int)(until - cpu->cycles_total);
+    cpu_run(cpu, until);
+  }
+}
+
+static bool flush(Apu* apu, int16_t* samples, FILE* out, long* total) {
+  size_t count = (size_t)apu->sample_count;
+  apu_set_output(apu, samples, CHUNK_SAMPLES);
+  *total += (long)count;
+  return fwrite(samples, sizeof(int16_t), count, out) == count;
+}
+
+static bool play(Emulator* emu, const Nsf* nsf, int song, double seconds,
+                 FILE* out, long* sample_total) {
+  Cpu* cpu = &emu->cpu;
+  Bus* bus = &emu->bus;
+  int16_t samples[CHUNK_SAMPLES];
+  apu_set_output(&bus->apu, samples, CHUNK_SAMPLES);
+  // Nothing is ever shown
+  bus->ppu.render = false;
+
+  for (int i = 0; i < 8; i++) {
+    mem_write(bus, (uint16_t)(0x5FF8 + i), nsf->banks[i]);
+  }
+  for (uint16_t addr = 0x4000; addr <= 0x4013; addr++) {
+    mem_write(bus, addr, 0);
+  }
+  mem_write(bus, 0x4015, 0x0F);
+  // No frame IRQs, players don't expect them
+  mem_write(bus, 0x4017, 0x40);
+
+  // INIT gets a second, it may have a lot of data to set up
+  long start = cpu->cycles_total;
+  call(cpu, nsf->init_addr, (uint8_t)(song - 1), 0);
+  if (!finish_call(cpu, start + (long)CPU_CLOCK)) {
+    fprintf(stderr, "INIT at $%04X never returned\n", nsf->init_addr);
+    return false;
+  }
+
+  // A PLAY that runs past its period keeps going and the calls it overlaps
+  // are dropped, which is what a real player's NMI handler does too
+  long end = start + (long)(seconds * CPU_CLOCK);
+  bool returned = true;
+  for (long calls = 1; cpu->cycles_total < end; calls++) {
+    long next = start + (long)(calls * nsf->play_period);
+    if (returned) {
+      call(cpu, nsf->play_addr, 0, 0);
+    }
+    returned = finish_call(cpu, next);
+    if (returned) {
+      idle(cpu, next);
+    }
+
+    bus_sync(bus);
+    if (!flush(&bus->apu, samples, out, sample_total)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool nsf_render(const Nsf* nsf, int song, double seconds, const char* path) {
+  if (song < 1 || song > nsf->song_count) {
+    fprintf(stderr, "No song %d, there are %d\n", song, nsf->song_count);
+    return false;
+  }
+
+  FILE* out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  Emulator* emu = emu_create(nsf->rom);
+  if (!emu) {
+    fprintf(stderr, "Out of memory\n");
+    fclose(out);
+    return false;
+  }
+
+  // The sizes are filled in once they are known
+  uint8_t header[WAV_HEADER_SIZE];
+  wav_header(header, 0);
+  long sample_total = 0;
+  bool ok = fwrite(header, 1, WAV_HEADER_SIZE, out) == WAV_HEADER_SIZE &&
+            play(emu, nsf, song, seconds, out, &sample_total);
+  if (ok) {
+    wav_header(header, (uint32_t)(sample_total * 2));
+    ok = fseek(out, 0, SEEK_SET) == 0 &&
+         fwrite(header, 1, WAV_HEADER_SIZE, out) == WAV_HEADER_SIZE;
+  }
+  if (fclose(out) != 0 || !ok) {
+    fprintf(stderr, "Could not write %s\n", path);
+    ok = false;
+  }
+
+  emu_destroy(emu);
+  return ok;
+}
+
+// === Batch rendering ==
+
+typedef struct NsfFile {
+  char name[256];
+  Nsf nsf;
+} NsfFile;
+
+typedef struct NsfJob {
+  const NsfFile* file;
+  int song;
+} NsfJob;
+
+typedef struct NsfBatch {
+  const char* out_dir;
+  double seconds;
+  NsfJob* jobs;
+  long job_count;
+  atomic_long next_job;
+  atomic_long failed;
+} NsfBatch;
+
+static bool read_nsf(const char* path, Nsf* nsf) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  unsigned char* data = size > 0 ? malloc((size_t)size) : NULL;
+  bool ok = data && fread(data, 1, (size_t)size, file) == (size_t)size &&
+            nsf_load(nsf, data, size);
+  fclose(file);
+  free(data);
+
+  if (!ok) {
+    fprintf(stderr, "Skipping %s, not an NSF we can play\n", path);
+  }
+  return ok;
+}
+
+static bool is_nsf_name(const char* name) {
+  size_t length = strlen(name);
+  return length > 4 && strcasecmp(name + length - 4, ".nsf") == 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+  return strcmp(((const NsfFile*)a)->name, ((const NsfFile*)b)->name);
+}
+
+// Loads every NSF in dir, sorted by name so the output is the same each run
+static NsfFile* load_dir(const char* dir, int* count) {
+  *count = 0;
+  DIR* listing = opendir(dir);
+  if (!listing) {
+    perror(dir);
+    return NULL;
+  }
+
+  NsfFile* files = NULL;
+  int capacity = 0;
+  struct dirent* entry;
+  while ((entry = readdir(listing))) {
+    if (!is_nsf_name(entry->d_name) || strlen(entry->d_name) >= 256) {
+      continue;
+    }
+    if (*count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      NsfFile* grown = realloc(files, (size_t)capacity * sizeof(NsfFile));
+      if (!grown) {
+        break;
+      }
+      files = grown;
+    }
+
+    NsfFile* file = &files[*count];
+    char path[4096];
+    snprintf(file->name, sizeof(file->name), "%s", entry->d_name);
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if (read_nsf(path, &file->nsf)) {
+      (*count)++;
+    }
+  }
+  closedir(listing);
+
+  qsort(files, (size_t)*count, sizeof(NsfFile), compare_names);
+  return files;
+}
+
+static void* render_thread(void* arg) {
+  NsfBatch* batch = arg;
+
+  for (;;) {
+    long index = atomic_fetch_add(&batch->next_job, 1);
+    if (index >= batch->job_count) {
+      break;
+    }
+
+    const NsfJob* job = &batch->jobs[index];
+    const char* name = job->file->name;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%.*s-%02d.wav", batch->out_dir,
+             (int)(strlen(name) - 4), name, job->song);
+
+    if (nsf_render(&job->file->nsf, job->song, batch->seconds, path)) {
+      printf("%s\n", path);
+    } else {
+      atomic_fetch_add(&batch->failed, 1);
+    }
+  }
+
+  return NULL;
+}
+
+static double elapsed_seconds(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+bool nsf_render_dir(const char* dir, const char* out_dir, double seconds) {
+  int file_count;
+  NsfFile* files = load_dir(dir, &file_count);
+  if (!file_count) {
+    fprintf(stderr, "No NSF files to render in %s\n", dir);
+    free(files);
+    return false;
+  }
+
+  NsfBatch batch = {.out_dir = out_dir, .seconds = seconds};
+  atomic_init(&batch.next_job, 0);
+  atomic_init(&batch.failed, 0);
+  for (int i = 0; i < file_count; i++) {
+    batch.job_count += files[i].nsf.song_count;
+  }
+  batch.jobs = malloc((size_t)(batch.job_count ? batch.job_count : 1) *
+                      sizeof(NsfJob));
+  if (!batch.jobs) {
+    batch.job_count = 0;
+    atomic_store(&batch.failed, 1);
+  }
+
+  long job = 0;
+  for (int i = 0; i < file_count && batch.jobs; i++) {
+    for (int song = 1; song <= files[i].nsf.song_count; song++) {
+      batch.jobs[job++] = (NsfJob){.file = &files[i], .song = song};
+    }
+  }
+
+  // Every track is independent, so one emulator per core keeps them all
+  // busy without any sharing beyond the job counter
+  long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (thread_count > batch.job_count) {
+    thread_count = batch.job_count;
+  }
+  if (thread_count < 1) {
+    thread_count = 1;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_t* threads = malloc((size_t)thread_count * sizeof(pthread_t));
+  long started = 0;
+  while (threads && started < thread_count &&
+         pthread_create(&threads[started], NULL, render_thread, &batch) == 0) {
+    started++;
+  }
+  // Without any threads the jobs still get done, just here
+  if (!started) {
+    render_thread(&batch);
+  }
+  for (long i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  double elapsed = elapsed_seconds(&start);
+  long failed = atomic_load(&batch.failed);
+  printf("Rendered %ld of %ld tracks from %d files in %.2fs on %ld threads, "
+         "%.0fx real time\n",
+         batch.job_count - failed, batch.job_count, file_count, elapsed,
+         started ? started : 1,
+         elapsed > 0 ? (double)batch.job_count * seconds / elapsed : 0);
+
+  free(threads);
+  free(batch.jobs);
+  for (int i = 0; i < file_count; i++) {
+    nsf_free(&files[i].nsf);
+  }
+  free(files);
+  return failed == 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// An NSF tune turned into an iNES image on mapper 31, whose 4K PRG banks
+// are the NSF bankswitching registers, so the player runs on a plain
+// emulator. Only NTSC timing and the 2A03's own channels are played.
+typedef struct Nsf {
+  // Header, PRG ROM and no CHR ROM, for emu_create
+  unsigned char* rom;
+
+  int song_count;
+  // 1 based, like the track numbers players show
+  int first_song;
+  uint16_t init_addr;
+  uint16_t play_addr;
+  // CPU cycles between PLAY calls
+  double play_period;
+  // Banks at $8000-$FFFF before INIT
+  uint8_t banks[8];
+
+  char title[33];
+  char artist[33];
+  char copyright[33];
+} Nsf;
+
+// Takes an NSF file's contents, false if it isn't one we can play
+bool nsf_load(Nsf* nsf, const unsigned char* data, long size);
+void nsf_free(Nsf* nsf);
+
+// Renders song (1 based) for that many seconds to a WAV file, running as
+// fast as the host can
+bool nsf_render(const Nsf* nsf, int song, double seconds, const char* path);
+// Renders every song of every .nsf file in dir to out_dir as
+// <name>-<song>.wav, on one thread per core
+bool nsf_render_dir(const char* dir, const char* out_dir, double seconds);
@@ -0,0 +1,104 @@
+#include "pace.h"
+#include <errno.h>
+#include <stdio.h>
+
+static const long NS_PER_SECOND = 1000000000;
+
+static long diff_ns(const struct timespec* a, const struct timespec* b) {
+  return (a->tv_sec - b->tv_sec) * NS_PER_SECOND + (a->tv_nsec - b->tv_nsec);
+}
+
+static void add_ns(struct timespec* ts, long ns) {
+  ts->tv_nsec += ns;
+  while (ts->tv_nsec >= NS_PER_SECOND) {
+    ts->tv_nsec -= NS_PER_SECOND;
+    ts->tv_sec++;
+  }
+  while (ts->tv_nsec < 0) {
+    ts->tv_nsec += NS_PER_SECOND;
+    ts->tv_sec--;
+  }
+}
+
+static int bucket(long ns) {
+  long us = ns / 1000;
+  int index = 0;
+  while (us > 0 && index < PACER_BUCKETS - 1) {
+    us >>= 1;
+    index++;
+  }
+
+  return index;
+}
+
+void pacer_init(Pacer* pacer, double hz, long spin_ns) {
+  *pacer = (Pacer){
+      .period_ns = (long)((double)NS_PER_SECOND / hz),
+      .spin_ns = spin_ns,
+  };
+
+  clock_gettime(CLOCK_MONOTONIC, &pacer->deadline);
+  pacer->frame_start = pacer->deadline;
+  add_ns(&pacer->deadline, pacer->period_ns);
+}
+
+void pacer_wait(Pacer* pacer) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pacer->work_histogram[bucket(diff_ns(&now, &pacer->frame_start))]++;
+
+  // Sleep most of the way, the scheduler's wakeup latency is covered by
+  // spinning for the rest
+  struct timespec wake = pacer->deadline;
+  add_ns(&wake, -pacer->spin_ns);
+  if (diff_ns(&wake, &now) > 0) {
+    // Signals cut the sleep short, anything else leaves it to the spin
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) ==
+           EINTR) {
+    }
+  }
+
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while (diff_ns(&pacer->deadline, &now) > 0);
+
+  long late = diff_ns(&now, &pacer->deadline);
+  pacer->wake_histogram[bucket(late)]++;
+  if (late > pacer->worst_wake_ns) {
+    pacer->worst_wake_ns = late;
+  }
+
+  pacer->frames++;
+  pacer->frame_start = now;
+
+  if (late > pacer->period_ns) {
+    // Too far behind (stopped in a debugger, host stalled), don't try to
+    // catch up with a burst of frames
+    pacer->missed++;
+    pacer->deadline = now;
+  }
+  add_ns(&pacer->deadline, pacer->period_ns);
+}
+
+static void print_histogram(const char* name, const long* histogram) {
+  printf("%s:\n", name);
+  for (int i = 0; i < PACER_BUCKETS; i++) {
+    if (!histogram[i]) {
+      continue;
+    }
+
+    long low = i ? 1L << (i - 1) : 0;
+    if (i == PACER_BUCKETS - 1) {
+      printf("  %6ld+      us: %ld\n", low, histogram[i]);
+    } else {
+      printf("  %6ld-%-6ld us: %ld\n", low, 1L << i, histogram[i]);
+    }
+  }
+}
+
+void pacer_print_stats(const Pacer* pacer) {
+  printf("%ld frames paced, %ld missed, worst wakeup %.1f us late\n",
+         pacer->frames, pacer->missed, (double)pacer->worst_wake_ns / 1000);
+  print_histogram("Wakeup latency", pacer->wake_histogram);
+  print_histogram("Frame work time", pacer->work_histogram);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// NTSC frame rate
+#define NTSC_FRAME_RATE 60.0988
+
+// Log2 buckets in microseconds, the last one collects everything above
+#define PACER_BUCKETS 18
+
+// Keeps frames on absolute deadlines so sleep errors never accumulate
+typedef struct Pacer {
+  long period_ns;
+  // The last stretch before a deadline is busy-waited
+  long spin_ns;
+
+  struct timespec deadline;
+  struct timespec frame_start;
+
+  long frames;
+  // Frames that were more than a whole period late and had to resync
+  long missed;
+
+  // How late we woke up after each deadline
+  long wake_histogram[PACER_BUCKETS];
+  // How long emulating each frame took
+  long work_histogram[PACER_BUCKETS];
+  long worst_wake_ns;
+} Pacer;
+
+void pacer_init(Pacer* pacer, double hz, long spin_ns);
+
+// Call after emulating a frame, returns once the frame is due
+void pacer_wait(Pacer* pacer);
+
+void pacer_print_stats(const Pacer* pacer);
@@ -0,0 +1,146 @@
+#include "perf.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* COUNTER_NAMES[PERF_COUNTERS] = {
+    "cycles", "instructions", "branch misses", "L1d misses", "LLC misses",
+};
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static uint64_t cache_miss(uint64_t cache) {
+  return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+         PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+
+static int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  // This thread on any CPU
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+bool perf_open(Perf* perf) {
+  *perf = (Perf){0};
+  perf->fds[PerfCycles] =
+      open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  perf->fds[PerfInstructions] =
+      open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  perf->fds[PerfBranchMisses] =
+      open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  perf->fds[PerfL1dMisses] =
+      open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D));
+  perf->fds[PerfLlcMisses] =
+      open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL));
+
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void perf_start(Perf* perf) {
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] >= 0) {
+      ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+void perf_stop(Perf* perf) {
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] < 0) {
+      continue;
+    }
+
+    ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    // Value, time enabled, time running
+    uint64_t data[3];
+    if (read(perf->fds[i], data, sizeof(data)) != (ssize_t)sizeof(data) ||
+        !data[2]) {
+      perf->values[i] = 0;
+      continue;
+    }
+    perf->values[i] = (double)data[0] * (double)data[1] / (double)data[2];
+  }
+}
+
+#else
+
+bool perf_open(Perf* perf) {
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    perf->fds[i] = -1;
+    perf->values[i] = 0;
+  }
+  return false;
+}
+
+void perf_start(Perf* perf) { (void)perf; }
+
+void perf_stop(Perf* perf) { (void)perf; }
+
+#endif
+
+void perf_close(Perf* perf) {
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (perf->fds[i] >= 0) {
+      close(perf->fds[i]);
+      perf->fds[i] = -1;
+    }
+  }
+}
+
+void perf_print(const Perf* perf, long instructions) {
+  const double* values = perf->values;
+  const int* fds = perf->fds;
+
+  printf("Host:");
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (fds[i] >= 0) {
+      printf(" %.0f %s", values[i], COUNTER_NAMES[i]);
+    } else {
+      printf(" %s n/a", COUNTER_NAMES[i]);
+    }
+    printf(i == PERF_COUNTERS - 1 ? "\n" : ",");
+  }
+
+  if (fds[PerfCycles] >= 0 && fds[PerfInstructions] >= 0 &&
+      values[PerfCycles] > 0) {
+    printf("IPC %.2f\n", values[PerfInstructions] / values[PerfCycles]);
+  }
+
+  if (!instructions) {
+    return;
+  }
+
+  // Where the host's time per 6502 instruction goes, dispatch mispredicts
+  // and table misses show up here first
+  printf("Per 6502 instruction:");
+  bool first = true;
+  for (int i = 0; i < PERF_COUNTERS; i++) {
+    if (fds[i] >= 0) {
+      printf("%s %.3f %s", first ? "" : ",", values[i] / (double)instructions,
+             COUNTER_NAMES[i]);
+      first = false;
+    }
+  }
+  printf(" (%ld instructions)\n", instructions);
+}
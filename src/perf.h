@@ -0,0 +1,32 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum PerfCounter {
+  PerfCycles,
+  PerfInstructions,
+  PerfBranchMisses,
+  PerfL1dMisses,
+  PerfLlcMisses,
+  PERF_COUNTERS
+} PerfCounter;
+
+// Hardware counters of the calling thread through perf_event_open, user
+// space only so the default perf_event_paranoid allows it. Counters the
+// machine or VM doesn't have are left out, fds[i] is -1 for those.
+typedef struct Perf {
+  int fds[PERF_COUNTERS];
+  // Scaled up when the kernel had to multiplex the counters
+  double values[PERF_COUNTERS];
+} Perf;
+
+// False if no counter could be opened at all
+bool perf_open(Perf* perf);
+void perf_close(Perf* perf);
+
+// Counting starts at zero, perf_stop reads the values
+void perf_start(Perf* perf);
+void perf_stop(Perf* perf);
+
+// Host totals, then per emulated instruction
+void perf_print(const Perf* perf, long instructions);
@@ -0,0 +1,92 @@
+#include "pipeline.h"
+#include <string.h>
+#include <time.h>
+
+static const struct timespec PAUSE = {.tv_nsec = 100000};
+
+static void* pipeline_thread(void* arg) {
+  PpuPipeline* pipeline = arg;
+
+  for (;;) {
+    // Check before looking for work so the last frame isn't missed
+    bool stopping = atomic_load(&pipeline->stop);
+
+    long drawn = atomic_load_explicit(&pipeline->drawn, memory_order_relaxed);
+    long submitted =
+        atomic_load_explicit(&pipeline->submitted, memory_order_acquire);
+    if (drawn == submitted) {
+      if (stopping) {
+        break;
+      }
+      nanosleep(&PAUSE, NULL);
+      continue;
+    }
+
+    pipeline->shadow.framebuffer = pipeline->framebuffers[drawn % 2];
+    ppu_replay(&pipeline->shadow, &pipeline->logs[drawn % 2]);
+    atomic_store_explicit(&pipeline->drawn, drawn + 1, memory_order_release);
+  }
+
+  return NULL;
+}
+
+bool pipeline_start(PpuPipeline* pipeline, Ppu* ppu) {
+  pipeline->ppu = ppu;
+  pipeline->shadow = *ppu;
+  pipeline->shadow.log = NULL;
+  pipeline->waited = 0;
+  atomic_init(&pipeline->submitted, 0);
+  atomic_init(&pipeline->drawn, 0);
+  atomic_init(&pipeline->stop, false);
+
+  // CHR RAM is written through $2007 like VRAM, so the worker needs a copy
+  // it can write to at its own pace
+  if (ppu->chr_writable) {
+    memcpy(pipeline->chr_ram, ppu->chr, sizeof(pipeline->chr_ram));
+    pipeline->shadow.chr = pipeline->chr_ram;
+  }
+
+  pipeline->logs[0].count = 0;
+  ppu->log = &pipeline->logs[0];
+  if (pthread_create(&pipeline->thread, NULL, pipeline_thread, pipeline)) {
+    ppu->log = NULL;
+    return false;
+  }
+  return true;
+}
+
+void pipeline_stop(PpuPipeline* pipeline) {
+  pipeline_wait(pipeline);
+  pipeline->ppu->log = NULL;
+  atomic_store(&pipeline->stop, true);
+  pthread_join(pipeline->thread, NULL);
+}
+
+static void wait_drawn(PpuPipeline* pipeline, long frames) {
+  while (atomic_load_explicit(&pipeline->drawn, memory_order_acquire) <
+         frames) {
+    pipeline->waited++;
+    nanosleep(&PAUSE, NULL);
+  }
+}
+
+void pipeline_submit(PpuPipeline* pipeline, uint8_t* framebuffer) {
+  long submitted =
+      atomic_load_explicit(&pipeline->submitted, memory_order_relaxed);
+
+  // The other log is about to be reused for the next frame
+  wait_drawn(pipeline, submitted);
+
+  pipeline->framebuffers[submitted % 2] = framebuffer;
+  atomic_store_explicit(&pipeline->submitted, submitted + 1,
+                        memory_order_release);
+
+  PpuLog* next = &pipeline->logs[(submitted + 1) % 2];
+  next->count = 0;
+  pipeline->ppu->log = next;
+}
+
+void pipeline_wait(PpuPipeline* pipeline) {
+  wait_drawn(pipeline,
+             atomic_load_explicit(&pipeline->submitted, memory_order_relaxed));
+}
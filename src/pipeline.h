@@ -0,0 +1,40 @@
+#pragma once
+#include "ppu.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Draws frames on a worker thread while the next one is emulated. The
+// emulated PPU only logs lines and VRAM/OAM writes, the worker replays each
+// frame's log into a copy of the PPU that does the drawing. Two logs
+// alternate, so the emulation runs at most one frame ahead.
+typedef struct PpuPipeline {
+  Ppu* ppu;
+  // Worker only, with its own CHR RAM and VRAM
+  Ppu shadow;
+  uint8_t chr_ram[0x2000];
+
+  PpuLog logs[2];
+  // Where each frame goes, NULL to only apply its writes
+  uint8_t* framebuffers[2];
+
+  // Frames handed to the worker and frames it has finished
+  atomic_long submitted;
+  atomic_long drawn;
+  atomic_bool stop;
+  pthread_t thread;
+
+  // Emulation side, times it caught up with the worker
+  long waited;
+} PpuPipeline;
+
+// Starts logging the PPU's writes, from its current state
+bool pipeline_start(PpuPipeline* pipeline, Ppu* ppu);
+void pipeline_stop(PpuPipeline* pipeline);
+
+// Ends the frame just emulated, to be drawn into framebuffer. Waits for the
+// frame before it first, so after this that one is complete.
+void pipeline_submit(PpuPipeline* pipeline, uint8_t* framebuffer);
+// Waits until every submitted frame is drawn
+void pipeline_wait(PpuPipeline* pipeline);
@@ -0,0 +1,665 @@
+#include "ppu.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// clang-format off
+static const int CTRL_NAMETABLE       = 0b00000011;
+static const int CTRL_INCREMENT       = 0b00000100;
+static const int CTRL_SPRITE_TABLE    = 0b00001000;
+static const int CTRL_BG_TABLE        = 0b00010000;
+static const int CTRL_SPRITE_SIZE     = 0b00100000;
+static const int CTRL_NMI             = 0b10000000;
+
+static const int MASK_GRAYSCALE       = 0b00000001;
+static const int MASK_BG_LEFT         = 0b00000010;
+static const int MASK_SPRITES_LEFT    = 0b00000100;
+static const int MASK_BG              = 0b00001000;
+static const int MASK_SPRITES         = 0b00010000;
+
+static const int STATUS_OVERFLOW      = 0b00100000;
+static const int STATUS_SPRITE_ZERO   = 0b01000000;
+static const int STATUS_VBLANK        = 0b10000000;
+// clang-format on
+
+static const int SCANLINE_VBLANK = 241;
+static const int SCANLINE_PRERENDER = 261;
+#define DOTS_PER_LINE 341
+
+Ppu ppu_init(unsigned char* rom, uint8_t* chr_ram, uint8_t* framebuffer) {
+  Ppu ppu = {
+      .mirroring = rom[6] & 1 ? MirrorVertical : MirrorHorizontal,
+      .render = true,
+      .framebuffer = framebuffer,
+  };
+
+  // CHR ROM comes right after PRG ROM, no CHR ROM means 8K of CHR RAM
+  if (rom[5]) {
+    ppu.chr = rom + 0x10 + rom[4] * 0x4000;
+  } else {
+    ppu.chr = chr_ram;
+    ppu.chr_writable = true;
+  }
+
+  return ppu;
+}
+
+// === PPU memory ==
+
+static uint16_t nametable_index(Ppu* ppu, uint16_t addr) {
+  addr &= 0x0FFF;
+  if (ppu->mirroring == MirrorVertical) {
+    return addr & 0x07FF;
+  }
+
+  return (uint16_t)(((addr >> 1) & 0x0400) | (addr & 0x03FF));
+}
+
+static uint8_t palette_index(uint16_t addr) {
+  addr &= 0x1F;
+  // The sprite backdrop entries mirror the background ones
+  if ((addr & 0x13) == 0x10) {
+    addr &= 0x0F;
+  }
+
+  return (uint8_t)addr;
+}
+
+static uint8_t vram_read(Ppu* ppu, uint16_t addr) {
+  addr &= 0x3FFF;
+  if (addr < 0x2000) {
+    return ppu->chr[addr];
+  }
+  if (addr < 0x3F00) {
+    return ppu->vram[nametable_index(ppu, addr)];
+  }
+
+  return ppu->palette[palette_index(addr)];
+}
+
+static void vram_write(Ppu* ppu, uint16_t addr, uint8_t val) {
+  addr &= 0x3FFF;
+  if (addr < 0x2000) {
+    if (ppu->chr_writable) {
+      ppu->chr[addr] = val;
+    }
+  } else if (addr < 0x3F00) {
+    ppu->vram[nametable_index(ppu, addr)] = val;
+  } else {
+    ppu->palette[palette_index(addr)] = val & 0x3F;
+  }
+}
+
+// === Scrolling ==
+
+static bool rendering_enabled(Ppu* ppu) {
+  return ppu->mask & (MASK_BG | MASK_SPRITES);
+}
+
+static void increment_y(Ppu* ppu) {
+  if ((ppu->v & 0x7000) != 0x7000) {
+    ppu->v += 0x1000;
+    return;
+  }
+
+  ppu->v &= ~0x7000;
+  int coarse_y = (ppu->v & 0x03E0) >> 5;
+  if (coarse_y == 29) {
+    // Wrap to the next vertical nametable
+    coarse_y = 0;
+    ppu->v ^= 0x0800;
+  } else if (coarse_y == 31) {
+    // Attribute rows wrap without switching nametables
+    coarse_y = 0;
+  } else {
+    coarse_y++;
+  }
+
+  ppu->v = (uint16_t)((ppu->v & ~0x03E0) | (coarse_y << 5));
+}
+
+static void copy_x(Ppu* ppu) {
+  ppu->v = (uint16_t)((ppu->v & ~0x041F) | (ppu->t & 0x041F));
+}
+
+static void copy_y(Ppu* ppu) {
+  ppu->v = (uint16_t)((ppu->v & ~0x7BE0) | (ppu->t & 0x7BE0));
+}
+
+// === Rendering ==
+
+// Background tile at the given tile column of the current line, returns the
+// palette number and fills the two pattern planes
+static int fetch_tile(Ppu* ppu, int column, uint8_t* lo, uint8_t* hi) {
+  uint16_t v = ppu->v;
+  int coarse_x = (v & 0x1F) + column;
+  uint16_t nametable = v & 0x0C00;
+  if (coarse_x >= 32) {
+    coarse_x -= 32;
+    nametable ^= 0x0400;
+  }
+  v = (uint16_t)((v & ~0x0C1F) | nametable | coarse_x);
+
+  uint8_t tile = vram_read(ppu, 0x2000 | (v & 0x0FFF));
+  uint8_t attr = vram_read(
+      ppu, (uint16_t)(0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)));
+  int shift = ((v >> 4) & 4) | (v & 2);
+
+  uint16_t pattern = (uint16_t)((ppu->ctrl & CTRL_BG_TABLE ? 0x1000 : 0) +
+                                tile * 16 + ((v >> 12) & 7));
+  *lo = ppu->chr[pattern];
+  *hi = ppu->chr[pattern + 8];
+
+  return (attr >> shift) & 3;
+}
+
+static uint8_t background_pixel(Ppu* ppu, int x) {
+  int column = x + ppu->fine_x;
+  uint8_t lo, hi;
+  int palette = fetch_tile(ppu, column / 8, &lo, &hi);
+
+  int bit = 7 - (column & 7);
+  int pixel = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+  return pixel ? (uint8_t)(palette << 2 | pixel) : 0;
+}
+
+// Pattern planes of a sprite row, already flipped horizontally
+static void fetch_sprite(Ppu* ppu, const uint8_t* sprite, int row,
+                         uint8_t* lo, uint8_t* hi) {
+  int height = ppu->ctrl & CTRL_SPRITE_SIZE ? 16 : 8;
+  uint8_t tile = sprite[1];
+  uint8_t attr = sprite[2];
+
+  if (attr & 0x80) {
+    row = height - 1 - row;
+  }
+
+  uint16_t table;
+  if (height == 8) {
+    table = ppu->ctrl & CTRL_SPRITE_TABLE ? 0x1000 : 0;
+  } else {
+    table = (uint16_t)((tile & 1) * 0x1000);
+    tile &= 0xFE;
+    if (row >= 8) {
+      tile++;
+      row -= 8;
+    }
+  }
+
+  uint16_t pattern = (uint16_t)(table + tile * 16 + row);
+  *lo = ppu->chr[pattern];
+  *hi = ppu->chr[pattern + 8];
+
+  if (attr & 0x40) {
+    // Reverse the bits so bit 7 is always the leftmost pixel
+    for (int i = 0; i < 2; i++) {
+      uint8_t* b = i ? hi : lo;
+      *b = (uint8_t)((*b & 0xF0) >> 4 | (*b & 0x0F) << 4);
+      *b = (uint8_t)((*b & 0xCC) >> 2 | (*b & 0x33) << 2);
+      *b = (uint8_t)((*b & 0xAA) >> 1 | (*b & 0x55) << 1);
+    }
+  }
+}
+
+static bool sprite_visible_at(Ppu* ppu, int x) {
+  return x >= 8 || ppu->mask & MASK_SPRITES_LEFT;
+}
+
+static bool background_visible_at(Ppu* ppu, int x) {
+  return x >= 8 || ppu->mask & MASK_BG_LEFT;
+}
+
+// Finds the sprites on the current line, sets the overflow flag, and
+// returns how many (up to 8) were found
+static int evaluate_sprites(Ppu* ppu, int* found) {
+  int height = ppu->ctrl & CTRL_SPRITE_SIZE ? 16 : 8;
+  int count = 0;
+
+  for (int i = 0; i < 64; i++) {
+    // Sprites are drawn one line below their Y coordinate
+    int row = ppu->scanline - ppu->oam[i * 4] - 1;
+    if (row < 0 || row >= height) {
+      continue;
+    }
+
+    if (count == 8) {
+      ppu->status |= STATUS_OVERFLOW;
+      break;
+    }
+
+    found[count++] = i;
+  }
+
+  return count;
+}
+
+static void check_sprite_zero(Ppu* ppu, const uint8_t* line_bg) {
+  if (!(ppu->mask & MASK_BG) || !(ppu->mask & MASK_SPRITES)) {
+    return;
+  }
+
+  const uint8_t* sprite = ppu->oam;
+  uint8_t lo, hi;
+  fetch_sprite(ppu, sprite, ppu->scanline - sprite[0] - 1, &lo, &hi);
+
+  for (int i = 0; i < 8; i++) {
+    int x = sprite[3] + i;
+    // Never hits on the last column
+    if (x >= 255) {
+      break;
+    }
+
+    int bit = 7 - i;
+    bool opaque = ((lo | hi) >> bit) & 1;
+    if (!opaque || !sprite_visible_at(ppu, x) || !background_visible_at(ppu, x)) {
+      continue;
+    }
+
+    uint8_t bg = line_bg ? line_bg[x] : background_pixel(ppu, x);
+    if (bg & 3) {
+      ppu->status |= STATUS_SPRITE_ZERO;
+      return;
+    }
+  }
+}
+
+// Frame skipping path, only work out the flags games can see
+static void evaluate_scanline(Ppu* ppu) {
+  int found[8];
+  int count = evaluate_sprites(ppu, found);
+
+  if (count && found[0] == 0 && !(ppu->status & STATUS_SPRITE_ZERO)) {
+    check_sprite_zero(ppu, NULL);
+  }
+}
+
+static void render_scanline(Ppu* ppu) {
+  uint8_t line_bg[PPU_WIDTH + 8] = {0};
+  uint8_t line_sprite[PPU_WIDTH] = {0};
+  bool sprite_behind[PPU_WIDTH] = {0};
+
+  if (ppu->mask & MASK_BG) {
+    for (int column = 0; column < 33; column++) {
+      uint8_t lo, hi;
+      int palette = fetch_tile(ppu, column, &lo, &hi);
+
+      for (int i = 0; i < 8; i++) {
+        int x = column * 8 + i - ppu->fine_x;
+        if (x < 0 || x >= PPU_WIDTH) {
+          continue;
+        }
+
+        int bit = 7 - i;
+        int pixel = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+        if (pixel && background_visible_at(ppu, x)) {
+          line_bg[x] = (uint8_t)(palette << 2 | pixel);
+        }
+      }
+    }
+  }
+
+  int found[8];
+  int count = evaluate_sprites(ppu, found);
+
+  if (ppu->mask & MASK_SPRITES) {
+    for (int n = 0; n < count; n++) {
+      const uint8_t* sprite = &ppu->oam[found[n] * 4];
+      uint8_t lo, hi;
+      fetch_sprite(ppu, sprite, ppu->scanline - sprite[0] - 1, &lo, &hi);
+
+      for (int i = 0; i < 8; i++) {
+        int x = sprite[3] + i;
+        // Lower OAM indices win, so never overwrite an earlier sprite
+        if (x >= PPU_WIDTH || line_sprite[x] || !sprite_visible_at(ppu, x)) {
+          continue;
+        }
+
+        int bit = 7 - i;
+        int pixel = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+        if (pixel) {
+          line_sprite[x] = (uint8_t)(0x10 | (sprite[2] & 3) << 2 | pixel);
+          sprite_behind[x] = sprite[2] & 0x20;
+        }
+      }
+    }
+
+    if (count && found[0] == 0 && !(ppu->status & STATUS_SPRITE_ZERO)) {
+      check_sprite_zero(ppu, line_bg);
+    }
+  }
+
+  uint8_t gray = ppu->mask & MASK_GRAYSCALE ? 0x30 : 0x3F;
+  uint8_t* out = ppu->framebuffer + ppu->scanline * PPU_WIDTH;
+  for (int x = 0; x < PPU_WIDTH; x++) {
+    uint8_t index = line_bg[x];
+    if (line_sprite[x] && (!sprite_behind[x] || !index)) {
+      index = line_sprite[x];
+    }
+
+    out[x] = ppu->palette[palette_index(index)] & gray;
+  }
+}
+
+static void draw_backdrop(Ppu* ppu) {
+  memset(ppu->framebuffer + ppu->scanline * PPU_WIDTH, ppu->palette[0],
+         PPU_WIDTH);
+}
+
+// === Write log ==
+
+static void log_entry(Ppu* ppu, PpuLogEntry entry) {
+  PpuLog* log = ppu->log;
+  if (log->count < PPU_LOG_SIZE) {
+    log->entries[log->count++] = entry;
+  }
+}
+
+static void log_line(Ppu* ppu) {
+  log_entry(ppu, (PpuLogEntry){
+                     .kind = PpuLogLine,
+                     .val = ppu->fine_x,
+                     .ctrl = ppu->ctrl,
+                     .mask = ppu->mask,
+                     .addr = ppu->v,
+                     .scanline = (uint16_t)ppu->scanline,
+                 });
+}
+
+void ppu_replay(Ppu* ppu, const PpuLog* log) {
+  for (long i = 0; i < log->count; i++) {
+    const PpuLogEntry* entry = &log->entries[i];
+    switch (entry->kind) {
+      case PpuLogLine:
+        if (!ppu->framebuffer) {
+          break;
+        }
+
+        ppu->scanline = entry->scanline;
+        ppu->v = entry->addr;
+        ppu->fine_x = entry->val;
+        ppu->ctrl = entry->ctrl;
+        ppu->mask = entry->mask;
+        if (rendering_enabled(ppu)) {
+          render_scanline(ppu);
+        } else {
+          draw_backdrop(ppu);
+        }
+        break;
+      case PpuLogVram:
+        vram_write(ppu, entry->addr, entry->val);
+        break;
+      case PpuLogOam:
+        ppu->oam[entry->addr] = entry->val;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// === Timing ==
+
+static void next_scanline(Ppu* ppu) {
+  ppu->dot = 0;
+  if (++ppu->scanline > SCANLINE_PRERENDER) {
+    ppu->scanline = 0;
+    ppu->odd_frame = !ppu->odd_frame;
+  }
+}
+
+void ppu_tick(Ppu* ppu) {
+  if (ppu->scanline < PPU_HEIGHT) {
+    if (ppu->dot == 256) {
+      // Logged lines are drawn elsewhere, only the flags are needed here
+      bool draw = ppu->render && !ppu->log;
+      if (ppu->log) {
+        log_line(ppu);
+      }
+
+      if (rendering_enabled(ppu)) {
+        if (draw) {
+          render_scanline(ppu);
+        } else {
+          evaluate_scanline(ppu);
+        }
+        increment_y(ppu);
+      } else if (draw) {
+        draw_backdrop(ppu);
+      }
+    } else if (ppu->dot == 257 && rendering_enabled(ppu)) {
+      copy_x(ppu);
+    }
+  } else if (ppu->scanline == SCANLINE_VBLANK && ppu->dot == 1) {
+    ppu->status |= STATUS_VBLANK;
+    ppu->frame_complete = true;
+    ppu->frame++;
+    if (ppu->ctrl & CTRL_NMI) {
+      ppu->nmi = true;
+    }
+  } else if (ppu->scanline == SCANLINE_PRERENDER) {
+    if (ppu->dot == 1) {
+      ppu->status &= ~(STATUS_VBLANK | STATUS_SPRITE_ZERO | STATUS_OVERFLOW);
+    }
+
+    if (rendering_enabled(ppu)) {
+      if (ppu->dot == 256) {
+        increment_y(ppu);
+      } else if (ppu->dot == 257) {
+        copy_x(ppu);
+      } else if (ppu->dot == 280) {
+        copy_y(ppu);
+      } else if (ppu->dot == 339 && ppu->odd_frame) {
+        // Odd frames are one dot shorter while rendering
+        ppu->dot++;
+      }
+    }
+  }
+
+  if (++ppu->dot > 340) {
+    next_scanline(ppu);
+  }
+}
+
+// First dot from the current one where ppu_tick does more than count,
+// DOTS_PER_LINE when nothing is left on this line
+static int next_busy_dot(const Ppu* ppu) {
+  static const int visible[] = {256, 257, DOTS_PER_LINE};
+  static const int vblank[] = {1, DOTS_PER_LINE};
+  static const int prerender[] = {1, 256, 257, 280, 339, DOTS_PER_LINE};
+
+  const int* dots;
+  if (ppu->scanline < PPU_HEIGHT) {
+    dots = visible;
+  } else if (ppu->scanline == SCANLINE_VBLANK) {
+    dots = vblank;
+  } else if (ppu->scanline == SCANLINE_PRERENDER) {
+    dots = prerender;
+  } else {
+    return DOTS_PER_LINE;
+  }
+
+  while (*dots < ppu->dot) {
+    dots++;
+  }
+  return *dots;
+}
+
+void ppu_run(Ppu* ppu, long dots) {
+  while (dots > 0) {
+    long idle = next_busy_dot(ppu) - ppu->dot;
+    if (idle == 0) {
+      ppu_tick(ppu);
+      dots--;
+      continue;
+    }
+
+    if (idle > dots) {
+      idle = dots;
+    }
+    ppu->dot += (int)idle;
+    dots -= idle;
+    if (ppu->dot == DOTS_PER_LINE) {
+      next_scanline(ppu);
+    }
+  }
+}
+
+long ppu_dots_to_vblank(const Ppu* ppu) {
+  long now = ppu->scanline * DOTS_PER_LINE + ppu->dot;
+  long vblank = SCANLINE_VBLANK * DOTS_PER_LINE + 1;
+  if (now > vblank) {
+    // Through the next frame, odd ones are a dot shorter if rendering is
+    // still on by then
+    vblank += (SCANLINE_PRERENDER + 1) * DOTS_PER_LINE - (ppu->odd_frame ? 1 : 0);
+  }
+
+  return vblank - now + 1;
+}
+
+long ppu_dots_to_status_change(const Ppu* ppu) {
+  long frame = (SCANLINE_PRERENDER + 1) * DOTS_PER_LINE;
+  long now = ppu->scanline * DOTS_PER_LINE + ppu->dot;
+  long changes[] = {
+      SCANLINE_VBLANK * DOTS_PER_LINE + 1,
+      SCANLINE_PRERENDER * DOTS_PER_LINE + 1,
+      // The next frame, a dot early in case it is a short one
+      frame - 1 + 256,
+      frame - 1 + SCANLINE_VBLANK * DOTS_PER_LINE + 1,
+      LONG_MAX,
+  };
+
+  // Sprite 0 and overflow are only set at dot 256 of visible lines, and
+  // only while rendering and not already set
+  uint8_t flags = STATUS_SPRITE_ZERO | STATUS_OVERFLOW;
+  bool rendering = ppu->mask & (MASK_BG | MASK_SPRITES);
+  if (rendering && (ppu->status & flags) != flags) {
+    int line = ppu->dot <= 256 ? ppu->scanline : ppu->scanline + 1;
+    if (line < PPU_HEIGHT) {
+      changes[4] = line * DOTS_PER_LINE + 256;
+    }
+  } else {
+    // The next frame's lines don't count either
+    changes[2] = LONG_MAX;
+  }
+
+  long first = LONG_MAX;
+  for (int i = 0; i < 5; i++) {
+    if (changes[i] >= now && changes[i] < first) {
+      first = changes[i];
+    }
+  }
+
+  return first - now;
+}
+
+// === CPU registers ==
+
+static uint8_t data_read(Ppu* ppu) {
+  uint8_t val;
+  if ((ppu->v & 0x3FFF) < 0x3F00) {
+    // Reads are delayed by one through the buffer
+    val = ppu->read_buffer;
+    ppu->read_buffer = vram_read(ppu, ppu->v);
+  } else {
+    // Palette reads are immediate, the buffer gets the nametable underneath
+    val = vram_read(ppu, ppu->v);
+    ppu->read_buffer = vram_read(ppu, ppu->v - 0x1000);
+  }
+
+  ppu->v += ppu->ctrl & CTRL_INCREMENT ? 32 : 1;
+  return val;
+}
+
+uint8_t ppu_read(Ppu* ppu, uint16_t addr) {
+  switch (addr & 7) {
+    case 2: {
+      uint8_t val = (ppu->status & 0xE0) | (ppu->open_bus & 0x1F);
+      ppu->status &= ~STATUS_VBLANK;
+      ppu->w = false;
+      ppu->open_bus = val;
+      return val;
+    }
+    case 4:
+      ppu->open_bus = ppu->oam[ppu->oam_addr];
+      return ppu->open_bus;
+    case 7:
+      ppu->open_bus = data_read(ppu);
+      return ppu->open_bus;
+    default:
+      // Write only registers return whatever was last on the bus
+      return ppu->open_bus;
+  }
+}
+
+uint8_t ppu_peek(Ppu* ppu, uint16_t addr) {
+  switch (addr & 7) {
+    case 2:
+      return (ppu->status & 0xE0) | (ppu->open_bus & 0x1F);
+    case 4:
+      return ppu->oam[ppu->oam_addr];
+    case 7:
+      return (ppu->v & 0x3FFF) < 0x3F00 ? ppu->read_buffer
+                                        : vram_read(ppu, ppu->v);
+    default:
+      return ppu->open_bus;
+  }
+}
+
+void ppu_write(Ppu* ppu, uint16_t addr, uint8_t val) {
+  ppu->open_bus = val;
+
+  switch (addr & 7) {
+    case 0:
+      // Enabling NMIs during vblank fires one right away
+      if (!(ppu->ctrl & CTRL_NMI) && val & CTRL_NMI &&
+          ppu->status & STATUS_VBLANK) {
+        ppu->nmi = true;
+      }
+      ppu->ctrl = val;
+      ppu->t = (uint16_t)((ppu->t & ~0x0C00) | (val & CTRL_NAMETABLE) << 10);
+      break;
+    case 1:
+      ppu->mask = val;
+      break;
+    case 3:
+      ppu->oam_addr = val;
+      break;
+    case 4:
+      if (ppu->log) {
+        log_entry(ppu, (PpuLogEntry){
+                           .kind = PpuLogOam, .val = val, .addr = ppu->oam_addr});
+      }
+      ppu->oam[ppu->oam_addr++] = val;
+      break;
+    case 5:
+      if (!ppu->w) {
+        ppu->t = (uint16_t)((ppu->t & ~0x001F) | val >> 3);
+        ppu->fine_x = val & 7;
+      } else {
+        ppu->t = (uint16_t)((ppu->t & ~0x73E0) | (val & 7) << 12 |
+                            (val >> 3) << 5);
+      }
+      ppu->w = !ppu->w;
+      break;
+    case 6:
+      if (!ppu->w) {
+        ppu->t = (uint16_t)((ppu->t & 0x00FF) | (val & 0x3F) << 8);
+      } else {
+        ppu->t = (uint16_t)((ppu->t & 0xFF00) | val);
+        ppu->v = ppu->t;
+      }
+      ppu->w = !ppu->w;
+      break;
+    case 7:
+      if (ppu->log) {
+        log_entry(ppu, (PpuLogEntry){.kind = PpuLogVram,
+                                     .val = val,
+                                     .addr = ppu->v & 0x3FFF});
+      }
+      vram_write(ppu, ppu->v, val);
+      ppu->v += ppu->ctrl & CTRL_INCREMENT ? 32 : 1;
+      break;
+    default:
+      break;
+  }
+}
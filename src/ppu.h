@@ -0,0 +1,98 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PPU_WIDTH 256
+#define PPU_HEIGHT 240
+
+typedef enum Mirroring { MirrorHorizontal, MirrorVertical } Mirroring;
+
+typedef enum PpuLogKind { PpuLogLine, PpuLogVram, PpuLogOam } PpuLogKind;
+
+typedef struct PpuLogEntry {
+  uint8_t kind;
+  // The byte written, fine X for lines
+  uint8_t val;
+  // Lines only, the registers drawing depends on
+  uint8_t ctrl;
+  uint8_t mask;
+  // VRAM or OAM address written, v for lines
+  uint16_t addr;
+  uint16_t scanline;
+} PpuLogEntry;
+
+// A frame of back to back OAM DMAs is one write every other CPU cycle,
+// 15K entries with every line
+#define PPU_LOG_SIZE 16384
+
+// Everything drawing a frame needs, in order: each line as it is reached
+// and every VRAM and OAM write in between
+typedef struct PpuLog {
+  PpuLogEntry entries[PPU_LOG_SIZE];
+  long count;
+} PpuLog;
+
+typedef struct Ppu {
+  // Pattern tables, CHR ROM or 8K of CHR RAM
+  unsigned char* chr;
+  bool chr_writable;
+  Mirroring mirroring;
+
+  uint8_t vram[0x0800];
+  uint8_t palette[0x20];
+  uint8_t oam[0x100];
+
+  // Registers
+  uint8_t ctrl;
+  uint8_t mask;
+  uint8_t status;
+  uint8_t oam_addr;
+  uint8_t read_buffer;
+  uint8_t open_bus;
+
+  // Loopy scroll registers
+  uint16_t v;
+  uint16_t t;
+  uint8_t fine_x;
+  bool w;
+
+  int dot;
+  int scanline;
+  long frame;
+  bool odd_frame;
+
+  // Set on vblank with NMIs enabled, cleared by whoever delivers it
+  bool nmi;
+  // Set when vblank starts, cleared by the frame loop
+  bool frame_complete;
+
+  // When false no pixels are produced, only the state games can observe
+  // (vblank, sprite 0 hit, overflow) keeps advancing
+  bool render;
+  // Palette indices, PPU_WIDTH * PPU_HEIGHT
+  uint8_t* framebuffer;
+  // When set, lines are logged here for ppu_replay instead of drawn
+  PpuLog* log;
+} Ppu;
+
+// chr_ram is 8K, only used without CHR ROM. The framebuffer is
+// PPU_WIDTH * PPU_HEIGHT.
+Ppu ppu_init(unsigned char* rom, uint8_t* chr_ram, uint8_t* framebuffer);
+
+void ppu_tick(Ppu* ppu);
+// Same as that many ppu_tick calls, dots where nothing happens are skipped
+void ppu_run(Ppu* ppu, long dots);
+// Dots until the one that starts vblank has been ticked, may come up short
+// by one around odd frames
+long ppu_dots_to_vblank(const Ppu* ppu);
+// Dots that can be ticked with $2002 reading the same, as long as nothing
+// writes to the PPU
+long ppu_dots_to_status_change(const Ppu* ppu);
+
+// Applies a log to a copy of the PPU, drawing its lines into the copy's
+// framebuffer (only applying the writes without one)
+void ppu_replay(Ppu* ppu, const PpuLog* log);
+
+uint8_t ppu_read(Ppu* ppu, uint16_t addr);
+uint8_t ppu_peek(Ppu* ppu, uint16_t addr);
+void ppu_write(Ppu* ppu, uint16_t addr, uint8_t val);
@@ -0,0 +1,63 @@
+#include "present.h"
+#include "framequeue.h"
+#include "pace.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static bool write_all(int fd, const uint8_t* data, size_t len) {
+  while (len) {
+    ssize_t written = write(fd, data, len);
+    if (written < 0) {
+      return false;
+    }
+
+    data += written;
+    len -= (size_t)written;
+  }
+
+  return true;
+}
+
+static void* present_thread(void* arg) {
+  Presenter* presenter = arg;
+
+  Pacer pacer;
+  pacer_init(&pacer, NTSC_FRAME_RATE, 0);
+
+  while (!atomic_load(&presenter->stop)) {
+    FrameSlot* slot = frame_queue_present(presenter->queue);
+    if (slot) {
+      if (!write_all(presenter->fd, slot->pixels, sizeof(slot->pixels))) {
+        perror("present");
+        break;
+      }
+      presenter->presented++;
+    }
+
+    pacer_wait(&pacer);
+  }
+
+  return NULL;
+}
+
+bool presenter_start(Presenter* presenter, FrameQueue* queue,
+                     const char* path) {
+  *presenter = (Presenter){.queue = queue};
+  atomic_init(&presenter->stop, false);
+
+  presenter->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (presenter->fd < 0) {
+    perror(path);
+    return false;
+  }
+
+  return pthread_create(&presenter->thread, NULL, present_thread, presenter) ==
+         0;
+}
+
+void presenter_stop(Presenter* presenter) {
+  atomic_store(&presenter->stop, true);
+  pthread_join(presenter->thread, NULL);
+  close(presenter->fd);
+}
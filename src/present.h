@@ -0,0 +1,22 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+typedef struct FrameQueue FrameQueue;
+
+// Shows frames from the queue on its own thread at the display rate. There
+// is no window yet, so "showing" means writing raw 256x240 palette index
+// frames to a file or pipe.
+typedef struct Presenter {
+  FrameQueue* queue;
+  int fd;
+
+  pthread_t thread;
+  atomic_bool stop;
+
+  long presented;
+} Presenter;
+
+bool presenter_start(Presenter* presenter, FrameQueue* queue, const char* path);
+void presenter_stop(Presenter* presenter);
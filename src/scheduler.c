@@ -0,0 +1,125 @@
+#include "scheduler.h"
+#include <limits.h>
+
+void scheduler_init(Scheduler* scheduler) {
+  *scheduler = (Scheduler){0};
+  for (int i = 0; i < EVENT_KINDS; i++) {
+    scheduler->position[i] = -1;
+  }
+}
+
+static void place(Scheduler* scheduler, int index, Event event) {
+  scheduler->heap[index] = event;
+  scheduler->position[event.kind] = index;
+}
+
+static void sift_up(Scheduler* scheduler, int index) {
+  Event event = scheduler->heap[index];
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (scheduler->heap[parent].cycle <= event.cycle) {
+      break;
+    }
+    place(scheduler, index, scheduler->heap[parent]);
+    index = parent;
+  }
+  place(scheduler, index, event);
+}
+
+static void sift_down(Scheduler* scheduler, int index) {
+  Event event = scheduler->heap[index];
+  for (;;) {
+    int child = index * 2 + 1;
+    if (child >= scheduler->count) {
+      break;
+    }
+    if (child + 1 < scheduler->count &&
+        scheduler->heap[child + 1].cycle < scheduler->heap[child].cycle) {
+      child++;
+    }
+    if (event.cycle <= scheduler->heap[child].cycle) {
+      break;
+    }
+    place(scheduler, index, scheduler->heap[child]);
+    index = child;
+  }
+  place(scheduler, index, event);
+}
+
+void scheduler_schedule(Scheduler* scheduler, EventKind kind, long cycle) {
+  int index = scheduler->position[kind];
+  if (index < 0) {
+    index = scheduler->count++;
+    place(scheduler, index, (Event){.cycle = cycle, .kind = kind});
+    sift_up(scheduler, index);
+    return;
+  }
+
+  long old = scheduler->heap[index].cycle;
+  scheduler->heap[index].cycle = cycle;
+  if (cycle < old) {
+    sift_up(scheduler, index);
+  } else {
+    sift_down(scheduler, index);
+  }
+}
+
+void scheduler_cancel(Scheduler* scheduler, EventKind kind) {
+  int index = scheduler->position[kind];
+  if (index < 0) {
+    return;
+  }
+
+  scheduler->position[kind] = -1;
+  if (index == --scheduler->count) {
+    return;
+  }
+
+  // Fill the hole with the last event and move that where it belongs
+  long cycle = scheduler->heap[index].cycle;
+  place(scheduler, index, scheduler->heap[scheduler->count]);
+  if (scheduler->heap[index].cycle < cycle) {
+    sift_up(scheduler, index);
+  } else {
+    sift_down(scheduler, index);
+  }
+}
+
+bool scheduler_pending(const Scheduler* scheduler, EventKind kind) {
+  return scheduler->position[kind] >= 0;
+}
+
+long scheduler_next(const Scheduler* scheduler) {
+  return scheduler->count ? scheduler->heap[0].cycle : LONG_MAX;
+}
+
+bool scheduler_pop(Scheduler* scheduler, long cycle, EventKind* kind) {
+  if (!scheduler->count || scheduler->heap[0].cycle > cycle) {
+    return false;
+  }
+
+  *kind = scheduler->heap[0].kind;
+  scheduler_cancel(scheduler, *kind);
+  scheduler->fired[*kind]++;
+  scheduler->frame_fired[*kind]++;
+  return true;
+}
+
+void scheduler_end_frame(Scheduler* scheduler) {
+  for (int i = 0; i < EVENT_KINDS; i++) {
+    if (scheduler->frame_fired[i] > scheduler->max_frame_fired[i]) {
+      scheduler->max_frame_fired[i] = scheduler->frame_fired[i];
+    }
+    scheduler->frame_fired[i] = 0;
+  }
+  scheduler->frames++;
+}
+
+const char* scheduler_event_name(EventKind kind) {
+  static const char* names[EVENT_KINDS] = {
+      [EventVblank] = "vblank",
+      [EventFrameIrq] = "frame IRQ",
+      [EventDmc] = "DMC",
+  };
+  return names[kind];
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdbool.h>
+
+// Things the CPU has to stop for, at most one of each is pending
+typedef enum EventKind {
+  // Vblank starts, the frame is done and an NMI may fire
+  EventVblank,
+  // The APU frame counter raises its IRQ
+  EventFrameIrq,
+  // The DMC clocks its output unit and may want a sample byte
+  EventDmc,
+  EVENT_KINDS
+} EventKind;
+
+typedef struct Event {
+  long cycle;
+  EventKind kind;
+} Event;
+
+// Min-heap of events keyed on the CPU cycle they are due
+typedef struct Scheduler {
+  Event heap[EVENT_KINDS];
+  int count;
+  // Heap position of every kind, -1 when not scheduled
+  int position[EVENT_KINDS];
+
+  // Events fired in total, in the current frame, and in the busiest frame
+  long fired[EVENT_KINDS];
+  long frame_fired[EVENT_KINDS];
+  long max_frame_fired[EVENT_KINDS];
+  long frames;
+} Scheduler;
+
+void scheduler_init(Scheduler* scheduler);
+
+// Adds the event, or moves it if it is already scheduled
+void scheduler_schedule(Scheduler* scheduler, EventKind kind, long cycle);
+void scheduler_cancel(Scheduler* scheduler, EventKind kind);
+bool scheduler_pending(const Scheduler* scheduler, EventKind kind);
+
+// Cycle of the earliest event, LONG_MAX when there is none
+long scheduler_next(const Scheduler* scheduler);
+// Removes the earliest event if it is due by cycle, counting it as fired
+bool scheduler_pop(Scheduler* scheduler, long cycle, EventKind* kind);
+
+// Closes the statistics of a frame
+void scheduler_end_frame(Scheduler* scheduler);
+
+const char* scheduler_event_name(EventKind kind);
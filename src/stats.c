@@ -0,0 +1,152 @@
+#include "stats.h"
+#include "cpu.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MODES (IndirectY + 1)
+
+static const char* MODE_NAMES[MODES] = {
+    "Implied",  "Accumulator", "Immediate", "ZeroPage", "ZeroPageX",
+    "ZeroPageY", "Relative",   "Absolute",  "AbsoluteX", "AbsoluteY",
+    "Indirect", "IndirectX",   "IndirectY",
+};
+
+static const char* REGION_NAMES[STATS_REGIONS] = {
+    "RAM", "PPU", "APU/IO", "Expansion", "PRG RAM", "PRG ROM",
+};
+
+void stats_instruction(Stats* stats, uint8_t opcode) {
+  stats->opcodes[opcode]++;
+}
+
+void stats_access(Stats* stats, uint16_t addr, bool write) {
+  if (write) {
+    stats->page_writes[addr >> 8]++;
+  } else {
+    stats->page_reads[addr >> 8]++;
+  }
+}
+
+StatsRegion stats_region(uint8_t page) {
+  if (page < 0x20) {
+    return RegionRam;
+  }
+  if (page < 0x40) {
+    return RegionPpu;
+  }
+  if (page == 0x40) {
+    return RegionApuIo;
+  }
+  if (page < 0x60) {
+    return RegionExpansion;
+  }
+  return page < 0x80 ? RegionPrgRam : RegionPrgRom;
+}
+
+const char* stats_region_name(StatsRegion region) {
+  return REGION_NAMES[region];
+}
+
+typedef struct Totals {
+  long modes[MODES];
+  long region_reads[STATS_REGIONS];
+  long region_writes[STATS_REGIONS];
+  long instructions;
+} Totals;
+
+static Totals sum(const Stats* stats) {
+  Totals totals = {0};
+  for (int i = 0; i < 0x100; i++) {
+    totals.modes[OPCODES[i][2]] += stats->opcodes[i];
+    totals.instructions += stats->opcodes[i];
+
+    StatsRegion region = stats_region((uint8_t)i);
+    totals.region_reads[region] += stats->page_reads[i];
+    totals.region_writes[region] += stats->page_writes[i];
+  }
+  return totals;
+}
+
+static const char* opcode_name(int opcode) {
+  return OPCODES_NAMES[OPCODES[opcode][0]];
+}
+
+// One row per counter: section,key,name,count
+static void write_csv(FILE* file, const Stats* stats, const Totals* totals) {
+  fprintf(file, "section,key,name,count\n");
+  fprintf(file, "total,instructions,,%ld\n", totals->instructions);
+
+  for (int i = 0; i < 0x100; i++) {
+    fprintf(file, "opcode,%02X,%s %s,%ld\n", i, opcode_name(i),
+            MODE_NAMES[OPCODES[i][2]], stats->opcodes[i]);
+  }
+  for (int i = 0; i < MODES; i++) {
+    fprintf(file, "mode,%d,%s,%ld\n", i, MODE_NAMES[i], totals->modes[i]);
+  }
+  for (int i = 0; i < 0x100; i++) {
+    fprintf(file, "page_read,%02X,,%ld\n", i, stats->page_reads[i]);
+    fprintf(file, "page_write,%02X,,%ld\n", i, stats->page_writes[i]);
+  }
+  for (int i = 0; i < STATS_REGIONS; i++) {
+    fprintf(file, "region_read,%d,%s,%ld\n", i, REGION_NAMES[i],
+            totals->region_reads[i]);
+    fprintf(file, "region_write,%d,%s,%ld\n", i, REGION_NAMES[i],
+            totals->region_writes[i]);
+  }
+}
+
+static void write_json(FILE* file, const Stats* stats, const Totals* totals) {
+  fprintf(file, "{\n  \"instructions\": %ld,\n  \"opcodes\": [\n",
+          totals->instructions);
+  for (int i = 0; i < 0x100; i++) {
+    fprintf(file,
+            "    {\"opcode\": \"%02X\", \"name\": \"%s\", \"mode\": \"%s\", "
+            "\"count\": %ld}%s\n",
+            i, opcode_name(i), MODE_NAMES[OPCODES[i][2]], stats->opcodes[i],
+            i == 0xFF ? "" : ",");
+  }
+
+  fprintf(file, "  ],\n  \"modes\": {\n");
+  for (int i = 0; i < MODES; i++) {
+    fprintf(file, "    \"%s\": %ld%s\n", MODE_NAMES[i], totals->modes[i],
+            i == MODES - 1 ? "" : ",");
+  }
+
+  fprintf(file, "  },\n  \"pages\": [\n");
+  for (int i = 0; i < 0x100; i++) {
+    fprintf(file, "    {\"page\": \"%02X\", \"reads\": %ld, \"writes\": %ld}%s\n",
+            i, stats->page_reads[i], stats->page_writes[i],
+            i == 0xFF ? "" : ",");
+  }
+
+  fprintf(file, "  ],\n  \"regions\": {\n");
+  for (int i = 0; i < STATS_REGIONS; i++) {
+    fprintf(file, "    \"%s\": {\"reads\": %ld, \"writes\": %ld}%s\n",
+            REGION_NAMES[i], totals->region_reads[i], totals->region_writes[i],
+            i == STATS_REGIONS - 1 ? "" : ",");
+  }
+  fprintf(file, "  }\n}\n");
+}
+
+static bool ends_with(const char* str, const char* suffix) {
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+bool stats_save(const Stats* stats, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+
+  Totals totals = sum(stats);
+  if (ends_with(path, ".json")) {
+    write_json(file, stats, &totals);
+  } else {
+    write_csv(file, stats, &totals);
+  }
+
+  bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
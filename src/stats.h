@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum StatsRegion {
+  RegionRam,
+  RegionPpu,
+  // $4000-$40FF, the few bytes of expansion space there included
+  RegionApuIo,
+  RegionExpansion,
+  RegionPrgRam,
+  RegionPrgRom,
+  STATS_REGIONS
+} StatsRegion;
+
+// What a run executes and where its bus accesses go. Plain counters owned
+// by one emulator, so nothing is shared between threads. Only opcodes and
+// pages are counted while running, addressing modes and regions are summed
+// from them when saving. Idle loops are not skipped while counting, so
+// polling loops are counted in full.
+typedef struct Stats {
+  long opcodes[0x100];
+  long page_reads[0x100];
+  long page_writes[0x100];
+} Stats;
+
+void stats_instruction(Stats* stats, uint8_t opcode);
+void stats_access(Stats* stats, uint16_t addr, bool write);
+
+StatsRegion stats_region(uint8_t page);
+const char* stats_region_name(StatsRegion region);
+
+// CSV, or JSON when the path ends in .json
+bool stats_save(const Stats* stats, const char* path);
@@ -1,6 +1,7 @@
 #include "util.h"
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 void set_flag(uint8_t* val, uint8_t flag, bool condition) {
   if (condition) {
@@ -9,3 +10,101 @@ void set_flag(uint8_t* val, uint8_t flag, bool condition) {
     *val &= ~flag;
   }
 }
+
+// Start with FNV_OFFSET_BASIS, or a previous hash to chain several buffers
+uint64_t hash_fnv1a(uint64_t hash, const void* data, size_t len) {
+  const uint8_t* bytes = data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3;
+  }
+
+  return hash;
+}
+
+static const uint64_t XXH_PRIME_1 = 0x9E3779B185EBCA87;
+static const uint64_t XXH_PRIME_2 = 0xC2B2AE3D27D4EB4F;
+static const uint64_t XXH_PRIME_3 = 0x165667B19E3779F9;
+static const uint64_t XXH_PRIME_4 = 0x85EBCA77C2B2AE63;
+static const uint64_t XXH_PRIME_5 = 0x27D4EB2F165667C5;
+
+static uint64_t rotl64(uint64_t val, int bits) {
+  return (val << bits) | (val >> (64 - bits));
+}
+
+// Little endian hosts only, like the rest of the file formats
+static uint64_t read64(const uint8_t* bytes) {
+  uint64_t val;
+  memcpy(&val, bytes, sizeof(val));
+  return val;
+}
+
+static uint32_t read32(const uint8_t* bytes) {
+  uint32_t val;
+  memcpy(&val, bytes, sizeof(val));
+  return val;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_PRIME_2;
+  return rotl64(acc, 31) * XXH_PRIME_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh64_round(0, val);
+  return acc * XXH_PRIME_1 + XXH_PRIME_4;
+}
+
+// XXH64, four independent 64-bit lanes over 32 byte stripes
+uint64_t hash_xxh64(const void* data, size_t len, uint64_t seed) {
+  const uint8_t* bytes = data;
+  const uint8_t* end = bytes + len;
+  uint64_t hash;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + XXH_PRIME_1 + XXH_PRIME_2;
+    uint64_t v2 = seed + XXH_PRIME_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - XXH_PRIME_1;
+
+    for (; end - bytes >= 32; bytes += 32) {
+      v1 = xxh64_round(v1, read64(bytes));
+      v2 = xxh64_round(v2, read64(bytes + 8));
+      v3 = xxh64_round(v3, read64(bytes + 16));
+      v4 = xxh64_round(v4, read64(bytes + 24));
+    }
+
+    hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    hash = xxh64_merge(hash, v1);
+    hash = xxh64_merge(hash, v2);
+    hash = xxh64_merge(hash, v3);
+    hash = xxh64_merge(hash, v4);
+  } else {
+    hash = seed + XXH_PRIME_5;
+  }
+
+  hash += len;
+
+  for (; end - bytes >= 8; bytes += 8) {
+    hash ^= xxh64_round(0, read64(bytes));
+    hash = rotl64(hash, 27) * XXH_PRIME_1 + XXH_PRIME_4;
+  }
+
+  if (end - bytes >= 4) {
+    hash ^= read32(bytes) * XXH_PRIME_1;
+    hash = rotl64(hash, 23) * XXH_PRIME_2 + XXH_PRIME_3;
+    bytes += 4;
+  }
+
+  for (; bytes < end; bytes++) {
+    hash ^= *bytes * XXH_PRIME_5;
+    hash = rotl64(hash, 11) * XXH_PRIME_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= XXH_PRIME_2;
+  hash ^= hash >> 29;
+  hash *= XXH_PRIME_3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -1,5 +1,13 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+static const uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325;
 
 void set_flag(uint8_t* val, uint8_t flag, bool condition);
+
+uint64_t hash_fnv1a(uint64_t hash, const void* data, size_t len);
+
+// Fast non-cryptographic hash, for comparing large buffers
+uint64_t hash_xxh64(const void* data, size_t len, uint64_t seed);
@@ -0,0 +1,28 @@
+#include "wav.h"
+#include "apu.h"
+#include <string.h>
+
+static void put_le16(uint8_t* out, uint32_t val) {
+  out[0] = (uint8_t)val;
+  out[1] = (uint8_t)(val >> 8);
+}
+
+static void put_le32(uint8_t* out, uint32_t val) {
+  put_le16(out, val);
+  put_le16(out + 2, val >> 16);
+}
+
+void wav_header(uint8_t* out, uint32_t data_size) {
+  memcpy(out, "RIFF", 4);
+  put_le32(out + 4, 36 + data_size);
+  memcpy(out + 8, "WAVEfmt ", 8);
+  put_le32(out + 16, 16);
+  put_le16(out + 20, 1); // PCM
+  put_le16(out + 22, 1); // Mono
+  put_le32(out + 24, APU_SAMPLE_RATE);
+  put_le32(out + 28, APU_SAMPLE_RATE * 2);
+  put_le16(out + 32, 2);
+  put_le16(out + 34, 16);
+  memcpy(out + 36, "data", 4);
+  put_le32(out + 40, data_size);
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+#define WAV_HEADER_SIZE 44
+
+// 16-bit mono PCM at APU_SAMPLE_RATE. Write it with a data size of 0 first
+// and again once the size is known.
+void wav_header(uint8_t* out, uint32_t data_size);
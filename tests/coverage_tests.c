@@ -0,0 +1,82 @@
+// Saves PRG ROM coverage maps and merges them back, including maps whose
+// first bytes look like whitespace to a text parser.
+#include "coverage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PRG_SIZE 0x4000
+
+static int failures;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+int main(void) {
+  static unsigned char rom[0x10 + PRG_SIZE] = {'N', 'E', 'S', 0x1A, 1};
+  static unsigned char other_rom[0x10 + PRG_SIZE] = {'N', 'E', 'S', 0x1A, 1};
+  for (long i = 0; i < PRG_SIZE; i++) {
+    rom[0x10 + i] = (unsigned char)(i * 7);
+  }
+  other_rom[0x10] = 1;
+
+  char path[] = "/tmp/cnes_coverageXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  // PRG bytes 0 and 1 read makes the first map byte 0x0A, a newline. The
+  // bytes after it are a tab, a space and a carriage return.
+  Coverage saved;
+  check(coverage_init(&saved, rom), "init");
+  coverage_mark(&saved, 0, CoverageRead);
+  coverage_mark(&saved, 1, CoverageRead);
+  coverage_mark(&saved, 4, CoverageOpcode);
+  coverage_mark(&saved, 5, CoverageRead);
+  coverage_mark(&saved, 10, CoverageRead);
+  coverage_mark(&saved, 12, CoverageOpcode);
+  coverage_mark(&saved, 13, CoverageOpcode | CoverageRead);
+  coverage_mark(&saved, PRG_SIZE - 1, CoverageOpcode);
+  check(saved.map[0] == 0x0A && saved.map[1] == 0x09 &&
+            saved.map[2] == 0x20 && saved.map[3] == 0x0D,
+        "map starts with whitespace bytes");
+  check(coverage_save(&saved, path), "save");
+
+  // Merging into an empty map gives back the saved one
+  Coverage merged;
+  check(coverage_init(&merged, rom), "init");
+  check(coverage_merge_file(&merged, path), "merge");
+  check(!memcmp(merged.map, saved.map, PRG_SIZE / 4), "round trip");
+
+  // Merging ORs into what is already there
+  coverage_mark(&merged, 100, CoverageOpcode);
+  check(coverage_merge_file(&merged, path), "merge again");
+  check(coverage_get(&merged, 100) == CoverageOpcode &&
+            coverage_get(&merged, 13) == (CoverageOpcode | CoverageRead) &&
+            coverage_get(&merged, 2) == 0,
+        "merge ORs");
+
+  // Maps of another ROM are refused
+  Coverage other;
+  check(coverage_init(&other, other_rom), "init");
+  check(!coverage_merge_file(&other, path), "other ROM refused");
+
+  // A missing file is nothing to merge
+  unlink(path);
+  check(coverage_merge_file(&merged, path), "missing file");
+
+  coverage_free(&saved);
+  coverage_free(&merged);
+  coverage_free(&other);
+
+  printf("%s\n", failures ? "Coverage tests failed" : "Coverage tests passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,501 @@
+// Runs single step CPU test vectors against cpu_execute, one JSON file per
+// opcode (00.json .. ff.json) in the community format:
+//
+//   [{"name": "a9 10 00",
+//     "initial": {"pc": 1, "s": 2, "a": 3, "x": 4, "y": 5, "p": 6,
+//                 "ram": [[1, 169], [2, 16]]},
+//     "final": {...},
+//     "cycles": [[1, 169, "read"], [2, 16, "read"]]}, ...]
+//
+// Needs the core built with CNES_FLAT_BUS. The cycle accurate core is
+// checked access by access, the fast core (-f) only by the number of
+// cycles.
+#include "bus.h"
+#include "cpu.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_RAM_ENTRIES 64
+#define MAX_CYCLES 16
+#define MAX_REPORTED 3
+
+typedef struct CpuState {
+  uint16_t pc;
+  uint8_t s;
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  uint8_t p;
+  int ram_count;
+  uint16_t ram_addr[MAX_RAM_ENTRIES];
+  uint8_t ram_val[MAX_RAM_ENTRIES];
+} CpuState;
+
+typedef struct TestCase {
+  char name[64];
+  CpuState initial;
+  CpuState final;
+  int cycles;
+  BusAccess accesses[MAX_CYCLES];
+} TestCase;
+
+// === JSON ==
+
+typedef struct Parser {
+  const char* pos;
+  bool failed;
+} Parser;
+
+static void skip_space(Parser* parser) {
+  while (isspace((unsigned char)*parser->pos)) {
+    parser->pos++;
+  }
+}
+
+static bool accept(Parser* parser, char c) {
+  skip_space(parser);
+  if (*parser->pos != c) {
+    return false;
+  }
+  parser->pos++;
+  return true;
+}
+
+static void expect(Parser* parser, char c) {
+  if (!accept(parser, c)) {
+    parser->failed = true;
+  }
+}
+
+static long parse_number(Parser* parser) {
+  skip_space(parser);
+  char* end;
+  long val = strtol(parser->pos, &end, 10);
+  if (end == parser->pos) {
+    parser->failed = true;
+  }
+  parser->pos = end;
+  return val;
+}
+
+static void parse_string(Parser* parser, char* out, size_t size) {
+  skip_space(parser);
+  if (*parser->pos != '"') {
+    parser->failed = true;
+    return;
+  }
+
+  size_t len = 0;
+  for (parser->pos++; *parser->pos && *parser->pos != '"'; parser->pos++) {
+    if (*parser->pos == '\\' && parser->pos[1]) {
+      parser->pos++;
+    }
+    if (out && len + 1 < size) {
+      out[len++] = *parser->pos;
+    }
+  }
+
+  if (out && size) {
+    out[len] = '\0';
+  }
+  if (*parser->pos != '"') {
+    parser->failed = true;
+    return;
+  }
+  parser->pos++;
+}
+
+static void skip_value(Parser* parser) {
+  skip_space(parser);
+  char c = *parser->pos;
+
+  if (c == '"') {
+    parse_string(parser, NULL, 0);
+  } else if (c == '[' || c == '{') {
+    char close = c == '[' ? ']' : '}';
+    parser->pos++;
+    if (accept(parser, close)) {
+      return;
+    }
+    do {
+      if (close == '}') {
+        parse_string(parser, NULL, 0);
+        expect(parser, ':');
+      }
+      skip_value(parser);
+    } while (!parser->failed && accept(parser, ','));
+    expect(parser, close);
+  } else {
+    // Numbers, true, false, null
+    while (*parser->pos && !strchr(",]}", *parser->pos) &&
+           !isspace((unsigned char)*parser->pos)) {
+      parser->pos++;
+    }
+  }
+}
+
+static void parse_state(Parser* parser, CpuState* state) {
+  *state = (CpuState){0};
+  expect(parser, '{');
+
+  do {
+    char key[16];
+    parse_string(parser, key, sizeof(key));
+    expect(parser, ':');
+
+    if (!strcmp(key, "pc")) {
+      state->pc = (uint16_t)parse_number(parser);
+    } else if (!strcmp(key, "s")) {
+      state->s = (uint8_t)parse_number(parser);
+    } else if (!strcmp(key, "a")) {
+      state->a = (uint8_t)parse_number(parser);
+    } else if (!strcmp(key, "x")) {
+      state->x = (uint8_t)parse_number(parser);
+    } else if (!strcmp(key, "y")) {
+      state->y = (uint8_t)parse_number(parser);
+    } else if (!strcmp(key, "p")) {
+      state->p = (uint8_t)parse_number(parser);
+    } else if (!strcmp(key, "ram")) {
+      expect(parser, '[');
+      if (!accept(parser, ']')) {
+        do {
+          expect(parser, '[');
+          long addr = parse_number(parser);
+          expect(parser, ',');
+          long val = parse_number(parser);
+          expect(parser, ']');
+
+          if (state->ram_count == MAX_RAM_ENTRIES) {
+            parser->failed = true;
+            return;
+          }
+          state->ram_addr[state->ram_count] = (uint16_t)addr;
+          state->ram_val[state->ram_count] = (uint8_t)val;
+          state->ram_count++;
+        } while (!parser->failed && accept(parser, ','));
+        expect(parser, ']');
+      }
+    } else {
+      skip_value(parser);
+    }
+  } while (!parser->failed && accept(parser, ','));
+
+  expect(parser, '}');
+}
+
+// Parses the next test of the top level array, false at the end
+static bool parse_test(Parser* parser, TestCase* test) {
+  if (accept(parser, ']') || parser->failed) {
+    return false;
+  }
+  accept(parser, ',');
+
+  *test = (TestCase){0};
+  expect(parser, '{');
+
+  do {
+    char key[16];
+    parse_string(parser, key, sizeof(key));
+    expect(parser, ':');
+
+    if (!strcmp(key, "name")) {
+      parse_string(parser, test->name, sizeof(test->name));
+    } else if (!strcmp(key, "initial")) {
+      parse_state(parser, &test->initial);
+    } else if (!strcmp(key, "final")) {
+      parse_state(parser, &test->final);
+    } else if (!strcmp(key, "cycles")) {
+      expect(parser, '[');
+      if (!accept(parser, ']')) {
+        do {
+          expect(parser, '[');
+          long addr = parse_number(parser);
+          expect(parser, ',');
+          long val = parse_number(parser);
+          expect(parser, ',');
+          char kind[8];
+          parse_string(parser, kind, sizeof(kind));
+          expect(parser, ']');
+
+          if (test->cycles < MAX_CYCLES) {
+            test->accesses[test->cycles] = (BusAccess){
+                .addr = (uint16_t)addr,
+                .val = (uint8_t)val,
+                .write = !strcmp(kind, "write"),
+            };
+          }
+          test->cycles++;
+        } while (!parser->failed && accept(parser, ','));
+        expect(parser, ']');
+      }
+    } else {
+      skip_value(parser);
+    }
+  } while (!parser->failed && accept(parser, ','));
+
+  expect(parser, '}');
+  return !parser->failed;
+}
+
+// === Running ==
+
+// Returns a description of the first difference, NULL if the test passed
+static const char* run_test(Cpu* cpu, const TestCase* test, char* diff,
+                            size_t size) {
+  Bus* bus = cpu->bus;
+  const CpuState* in = &test->initial;
+  const CpuState* out = &test->final;
+
+  cpu->pc = in->pc;
+  cpu->sp = in->s;
+  cpu->a = in->a;
+  cpu->x = in->x;
+  cpu->y = in->y;
+  cpu->status = in->p;
+  cpu->cycles_remaining = 0;
+  cpu->nmi_pending = false;
+  cpu->irq_line = false;
+  for (int i = 0; i < in->ram_count; i++) {
+    bus->cpu_ram[in->ram_addr[i]] = in->ram_val[i];
+  }
+
+  long start = cpu->cycles_total;
+  cpu->access_count = 0;
+  // KIL leaves the fast core with a negative count
+  do {
+    cpu_execute(cpu);
+  } while (cpu->cycles_remaining > 0);
+  long cycles = cpu->cycles_total - start;
+
+  const char* result = NULL;
+  if (cpu->pc != out->pc || cpu->sp != out->s || cpu->a != out->a ||
+      cpu->x != out->x || cpu->y != out->y || cpu->status != out->p) {
+    snprintf(diff, size,
+             "got PC:%04X S:%02X A:%02X X:%02X Y:%02X P:%02X, "
+             "want PC:%04X S:%02X A:%02X X:%02X Y:%02X P:%02X",
+             cpu->pc, cpu->sp, cpu->a, cpu->x, cpu->y, cpu->status, out->pc,
+             out->s, out->a, out->x, out->y, out->p);
+    result = diff;
+  }
+
+  for (int i = 0; !result && i < out->ram_count; i++) {
+    uint8_t val = bus->cpu_ram[out->ram_addr[i]];
+    if (val != out->ram_val[i]) {
+      snprintf(diff, size, "got $%04X = %02X, want %02X", out->ram_addr[i], val,
+               out->ram_val[i]);
+      result = diff;
+    }
+  }
+
+  if (!result && cycles != test->cycles) {
+    snprintf(diff, size, "took %ld cycles, want %d", cycles, test->cycles);
+    result = diff;
+  }
+
+  for (int i = 0; !result && cpu->access_log && i < test->cycles; i++) {
+    const BusAccess* got = &cpu->access_log[i];
+    const BusAccess* want = &test->accesses[i];
+    if (got->addr != want->addr || got->val != want->val ||
+        got->write != want->write) {
+      snprintf(diff, size, "cycle %d: got %s $%04X = %02X, want %s $%04X = %02X",
+               i + 1, got->write ? "write" : "read", got->addr, got->val,
+               want->write ? "write" : "read", want->addr, want->val);
+      result = diff;
+    }
+  }
+
+  // Leave the memory clean for the next test
+  for (int i = 0; i < in->ram_count; i++) {
+    bus->cpu_ram[in->ram_addr[i]] = 0;
+  }
+  for (int i = 0; i < out->ram_count; i++) {
+    bus->cpu_ram[out->ram_addr[i]] = 0;
+  }
+
+  return result;
+}
+
+static char* read_file(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  char* data = malloc((size_t)size + 1);
+  if (data) {
+    data[fread(data, 1, (size_t)size, file)] = '\0';
+  }
+
+  fclose(file);
+  return data;
+}
+
+typedef struct Results {
+  bool found;
+  bool malformed;
+  long passed;
+  long failed;
+  // First failures, already formatted
+  char report[MAX_REPORTED][256];
+} Results;
+
+typedef struct Runner {
+  const char* dir;
+  bool fast;
+  atomic_int next_opcode;
+  Results results[0x100];
+} Runner;
+
+static void run_file(Runner* runner, int opcode, Cpu* cpu) {
+  Results* results = &runner->results[opcode];
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%02x.json", runner->dir, opcode);
+  char* data = read_file(path);
+  if (!data) {
+    return;
+  }
+  results->found = true;
+
+  Parser parser = {.pos = data};
+  expect(&parser, '[');
+
+  TestCase test;
+  while (parse_test(&parser, &test)) {
+    char diff[160];
+    if (!run_test(cpu, &test, diff, sizeof(diff))) {
+      results->passed++;
+      continue;
+    }
+
+    if (results->failed < MAX_REPORTED) {
+      snprintf(results->report[results->failed], sizeof(results->report[0]),
+               "  %s: %s", test.name, diff);
+    }
+    results->failed++;
+  }
+
+  results->malformed = parser.failed;
+  free(data);
+}
+
+static void* worker(void* arg) {
+  Runner* runner = arg;
+
+  // Every thread gets its own machine
+  Bus bus = bus_init(NULL);
+  Cpu cpu = cpu_init(&bus);
+  bus.cpu = &cpu;
+
+  BusAccess log[MAX_CYCLES];
+  cpu.cycle_accurate = !runner->fast;
+  if (cpu.cycle_accurate) {
+    cpu.access_log = log;
+    cpu.access_log_size = MAX_CYCLES;
+  }
+
+  int opcode;
+  while ((opcode = atomic_fetch_add(&runner->next_opcode, 1)) < 0x100) {
+    run_file(runner, opcode, &cpu);
+  }
+
+  free(bus.cpu_ram);
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  static Runner runner;
+  // Cases every file must have, so a cut down set can't pass for the full
+  // one
+  long min_cases = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fn:")) != -1) {
+    switch (opt) {
+      case 'f':
+        runner.fast = true;
+        break;
+      case 'n':
+        min_cases = strtol(optarg, NULL, 10);
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+
+  if (optind != argc - 1) {
+    printf("Syntax: %s [-f] [-n CASES] <test vector directory>\n", argv[0]);
+    printf("  -f        test the fast core instead of the cycle accurate "
+           "one\n");
+    printf("  -n CASES  fail if a file has fewer than CASES tests\n");
+    return 1;
+  }
+
+  runner.dir = argv[optind];
+  atomic_init(&runner.next_opcode, 0);
+
+  long thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (thread_count < 1) {
+    thread_count = 1;
+  }
+  if (thread_count > 64) {
+    thread_count = 64;
+  }
+
+  pthread_t threads[64];
+  for (long i = 0; i < thread_count; i++) {
+    pthread_create(&threads[i], NULL, worker, &runner);
+  }
+  for (long i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  long passed = 0;
+  long failed = 0;
+  int files = 0;
+  int failing_opcodes = 0;
+  int short_files = 0;
+  for (int opcode = 0; opcode < 0x100; opcode++) {
+    const Results* results = &runner.results[opcode];
+    if (!results->found) {
+      continue;
+    }
+
+    files++;
+    passed += results->passed;
+    failed += results->failed;
+
+    if (results->passed + results->failed < min_cases) {
+      short_files++;
+    }
+
+    if (results->failed || results->malformed) {
+      failing_opcodes++;
+      printf("%02X: %ld/%ld failed%s\n", opcode, results->failed,
+             results->passed + results->failed,
+             results->malformed ? ", malformed file" : "");
+      for (long i = 0; i < results->failed && i < MAX_REPORTED; i++) {
+        printf("%s\n", results->report[i]);
+      }
+    }
+  }
+
+  printf("%d files, %ld tests, %ld failed, %d opcodes failing\n", files,
+         passed + failed, failed, failing_opcodes);
+  if (short_files) {
+    printf("%d files have fewer than %ld tests, not the full set\n",
+           short_files, min_cases);
+  }
+  return files && !failing_opcodes && !short_files ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+// Runs lanes of a mapper 31 ROM with different inputs and checks each one
+// ends up where the scalar core gets with the same inputs. The inputs pick
+// which bank the subroutine at $8000 is called from, so lanes at the same
+// PC run different code.
+#include "emulator.h"
+#include "lanes.h"
+#include "movie.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LANE_COUNT 16
+#define BANK_SIZE 0x1000
+#define ROM_SIZE (0x10 + 8 * BANK_SIZE)
+// Inputs change every STEP_CYCLES, for STEPS steps
+#define STEP_CYCLES 1000
+#define STEPS 200
+
+// Reads A and B, calling $8000 in bank 0 or 1 after each
+static const uint8_t MAIN[] = {
+    0x78,             // SEI
+    0xD8,             // CLD
+    0xA2, 0xFF,       // LDX #$FF
+    0x9A,             // TXS
+    0xA9, 0x01,       // LDA #$01      $F005
+    0x8D, 0x16, 0x40, // STA $4016
+    0xA9, 0x00,       // LDA #$00
+    0x8D, 0x16, 0x40, // STA $4016
+    0xAD, 0x16, 0x40, // LDA $4016
+    0x29, 0x01,       // AND #$01
+    0x8D, 0x00, 0x50, // STA $5000
+    0x20, 0x00, 0x80, // JSR $8000
+    0xAD, 0x16, 0x40, // LDA $4016
+    0x29, 0x01,       // AND #$01
+    0x8D, 0x00, 0x50, // STA $5000
+    0x20, 0x00, 0x80, // JSR $8000
+    0x4C, 0x05, 0xF0, // JMP $F005
+};
+
+static const uint8_t BANK0[] = {
+    0xE6, 0x10, // INC $10
+    0xA5, 0x10, // LDA $10
+    0x65, 0x11, // ADC $11
+    0x85, 0x11, // STA $11
+    0x60,       // RTS
+};
+
+static const uint8_t BANK1[] = {
+    0xC6, 0x12, // DEC $12
+    0xA5, 0x12, // LDA $12
+    0x45, 0x11, // EOR $11
+    0x85, 0x11, // STA $11
+    0x0A,       // ASL A
+    0x85, 0x13, // STA $13
+    0x60,       // RTS
+};
+
+static int failures;
+
+static void build_rom(unsigned char* rom) {
+  memset(rom, 0, ROM_SIZE);
+  memcpy(rom, "NES\x1A", 4);
+  rom[4] = 2;
+  rom[6] = 0xF0;
+  rom[7] = 0x10;
+
+  unsigned char* prg = rom + 0x10;
+  memcpy(prg, BANK0, sizeof(BANK0));
+  memcpy(prg + BANK_SIZE, BANK1, sizeof(BANK1));
+  unsigned char* fixed = prg + 7 * BANK_SIZE;
+  memcpy(fixed, MAIN, sizeof(MAIN));
+  // NMI, reset and IRQ all at $F000
+  for (int i = 0; i < 3; i++) {
+    fixed[0xFFA + i * 2] = 0x00;
+    fixed[0xFFB + i * 2] = 0xF0;
+  }
+}
+
+static uint8_t buttons(int lane, int step) {
+  uint32_t x = (uint32_t)(lane * 7919 + step * 104729);
+  x ^= x >> 7;
+  x *= 0x9E3779B1u;
+  return (uint8_t)(x >> 24);
+}
+
+int main(void) {
+  static unsigned char rom[ROM_SIZE];
+  build_rom(rom);
+
+  Emulator* lane_emus[LANE_COUNT];
+  Emulator* scalar_emus[LANE_COUNT];
+  for (int i = 0; i < LANE_COUNT; i++) {
+    lane_emus[i] = emu_create(rom);
+    scalar_emus[i] = emu_create(rom);
+    if (!lane_emus[i] || !scalar_emus[i]) {
+      printf("Out of memory\n");
+      return 1;
+    }
+    cpu_reset(&lane_emus[i]->cpu);
+    cpu_reset(&scalar_emus[i]->cpu);
+  }
+
+  Lanes lanes;
+  lanes_init(&lanes, lane_emus, LANE_COUNT);
+
+  for (int step = 1; step <= STEPS; step++) {
+    for (int i = 0; i < LANE_COUNT; i++) {
+      lane_emus[i]->bus.controllers[0].buttons = buttons(i, step);
+      scalar_emus[i]->bus.controllers[0].buttons = buttons(i, step);
+    }
+
+    long until = (long)step * STEP_CYCLES;
+    lanes_run(&lanes, until);
+    for (int i = 0; i < LANE_COUNT; i++) {
+      cpu_run(&scalar_emus[i]->cpu, until);
+    }
+  }
+
+  for (int i = 0; i < LANE_COUNT; i++) {
+    Cpu* lane = &lane_emus[i]->cpu;
+    Cpu* scalar = &scalar_emus[i]->cpu;
+    uint64_t lane_hash = movie_state_hash(lane);
+    uint64_t scalar_hash = movie_state_hash(scalar);
+    if (lane_hash != scalar_hash || lane->cycles_total != scalar->cycles_total) {
+      printf("FAILED: lane %d state %016" PRIx64 " after %ld cycles, scalar "
+             "%016" PRIx64 " after %ld\n",
+             i, lane_hash, lane->cycles_total, scalar_hash,
+             scalar->cycles_total);
+      failures++;
+    }
+  }
+
+  if (!lanes.batches) {
+    printf("FAILED: nothing was batched\n");
+    failures++;
+  }
+
+  for (int i = 0; i < LANE_COUNT; i++) {
+    emu_destroy(lane_emus[i]);
+    emu_destroy(scalar_emus[i]);
+  }
+
+  printf("%s\n", failures ? "Lanes tests failed" : "Lanes tests passed");
+  return failures ? 1 : 0;
+}
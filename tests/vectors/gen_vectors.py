@@ -0,0 +1,315 @@
+# Generates the single step vectors in nes6502/ from a small NMOS 6502 model
+# (2A03, no decimal mode) written from 6502_cpu.txt, independent of the
+# emulator's cores. Writes <dir>/<opcode>.json in the community format:
+#
+#   python3 gen_vectors.py nes6502 8
+#
+# They are a smoke test of the CPU tests and the cores, not conformance: 8
+# random cases per opcode miss most flag and page crossing corner cases the
+# full community set of 10000 per opcode covers.
+#
+# The unstable $8B and $AB and the KIL opcodes have no vectors.
+import json, random, sys, os
+
+class Mem:
+    def __init__(s, rng):
+        s.rng = rng; s.init = {}; s.cur = {}; s.cycles = []
+    def peek(s, a):
+        a &= 0xFFFF
+        if a not in s.cur:
+            v = s.rng.randrange(256); s.init[a] = v; s.cur[a] = v
+        return s.cur[a]
+    def read(s, a):
+        a &= 0xFFFF; v = s.peek(a); s.cycles.append([a, v, "read"]); return v
+    def write(s, a, v):
+        a &= 0xFFFF; v &= 0xFF; s.cur[a] = v; s.cycles.append([a, v, "write"])
+    def preset(s, a, v):
+        a &= 0xFFFF; s.init[a] = v; s.cur[a] = v
+
+C,Z,I,D,B,U,V,N = 1,2,4,8,16,32,64,128
+
+class Cpu:
+    def __init__(s, m, st):
+        s.m = m; s.pc, s.s, s.a, s.x, s.y, s.p = st
+    def setf(s, f, on):
+        s.p = (s.p | f) if on else (s.p & ~f)
+    def nz(s, v):
+        v &= 0xFF; s.setf(Z, v == 0); s.setf(N, v & 0x80); return v
+    def fetch(s):
+        v = s.m.read(s.pc); s.pc = (s.pc + 1) & 0xFFFF; return v
+    def push(s, v):
+        s.m.write(0x100 + s.s, v); s.s = (s.s - 1) & 0xFF
+    def pull(s):
+        s.s = (s.s + 1) & 0xFF; return s.m.read(0x100 + s.s)
+
+READ, WRITE, RMW = 'r', 'w', 'm'
+
+def adc(c, v):
+    r = c.a + v + (c.p & C)
+    c.setf(V, (~(c.a ^ v) & (c.a ^ r)) & 0x80)
+    c.setf(C, r > 0xFF); c.a = c.nz(r)
+def sbc(c, v): adc(c, v ^ 0xFF)
+def cmp(c, r, v):
+    c.setf(C, r >= v); c.nz(r - v)
+def asl(c, v): c.setf(C, v & 0x80); return c.nz(v << 1)
+def lsr(c, v): c.setf(C, v & 1); return c.nz(v >> 1)
+def rol(c, v):
+    r = (v << 1) | (c.p & C); c.setf(C, v & 0x80); return c.nz(r)
+def ror(c, v):
+    r = (v >> 1) | ((c.p & C) << 7); c.setf(C, v & 1); return c.nz(r)
+
+# Read ops take the value, write ops return the value, RMW ops map old->new
+def op_lda(c, v): c.a = c.nz(v)
+def op_ldx(c, v): c.x = c.nz(v)
+def op_ldy(c, v): c.y = c.nz(v)
+def op_lax(c, v): c.a = c.x = c.nz(v)
+def op_and(c, v): c.a = c.nz(c.a & v)
+def op_ora(c, v): c.a = c.nz(c.a | v)
+def op_eor(c, v): c.a = c.nz(c.a ^ v)
+def op_bit(c, v):
+    c.setf(Z, (c.a & v) == 0); c.setf(N, v & 0x80); c.setf(V, v & 0x40)
+def op_nop(c, v): pass
+def op_anc(c, v): c.a = c.nz(c.a & v); c.setf(C, c.a & 0x80)
+def op_alr(c, v): c.a = lsr(c, c.a & v)
+def op_arr(c, v):
+    t = c.a & v; r = (t >> 1) | ((c.p & C) << 7); c.a = c.nz(r)
+    c.setf(C, r & 0x40); c.setf(V, ((r >> 6) ^ (r >> 5)) & 1)
+def op_axs(c, v):
+    t = c.a & c.x; c.setf(C, t >= v); c.x = c.nz(t - v)
+def op_las(c, v): c.a = c.x = c.s = c.nz(v & c.s)
+READS = dict(LDA=op_lda, LDX=op_ldx, LDY=op_ldy, LAX=op_lax, AND=op_and,
+             ORA=op_ora, EOR=op_eor, BIT=op_bit, NOP=op_nop, ANC=op_anc,
+             ALR=op_alr, ARR=op_arr, AXS=op_axs, LAS=op_las,
+             ADC=adc, SBC=sbc,
+             CMP=lambda c, v: cmp(c, c.a, v), CPX=lambda c, v: cmp(c, c.x, v),
+             CPY=lambda c, v: cmp(c, c.y, v))
+WRITES = dict(STA=lambda c: c.a, STX=lambda c: c.x, STY=lambda c: c.y,
+              SAX=lambda c: c.a & c.x)
+def slo(c, v): r = asl(c, v); op_ora(c, r); return r
+def rla(c, v): r = rol(c, v); op_and(c, r); return r
+def sre(c, v): r = lsr(c, v); op_eor(c, r); return r
+def rra(c, v): r = ror(c, v); adc(c, r); return r
+def dcp(c, v): r = (v - 1) & 0xFF; cmp(c, c.a, r); return r
+def isb(c, v): r = (v + 1) & 0xFF; sbc(c, r); return r
+RMWS = dict(ASL=asl, LSR=lsr, ROL=rol, ROR=ror,
+            INC=lambda c, v: c.nz(v + 1), DEC=lambda c, v: c.nz(v - 1),
+            SLO=slo, RLA=rla, SRE=sre, RRA=rra, DCP=dcp, ISB=isb)
+# Unstable stores, value is reg & (H + 1) of the base address
+UNSTABLE = dict(SHA=lambda c: c.a & c.x, SHX=lambda c: c.x,
+                SHY=lambda c: c.y, TAS=None)
+
+def kind(name):
+    if name in READS: return READ
+    if name in WRITES or name in UNSTABLE: return WRITE
+    return RMW
+
+def operate(c, name, addr, base_hi=None, crossed=False):
+    m = c.m; k = kind(name)
+    if name in UNSTABLE:
+        if name == 'TAS':
+            c.s = c.a & c.x; reg = c.s
+        else:
+            reg = UNSTABLE[name](c)
+        val = reg & ((base_hi + 1) & 0xFF)
+        if crossed: addr = (val << 8) | (addr & 0xFF)
+        m.write(addr, val)
+    elif k == READ:
+        READS[name](c, m.read(addr))
+    elif k == WRITE:
+        m.write(addr, WRITES[name](c))
+    else:
+        v = m.read(addr); m.write(addr, v); m.write(addr, RMWS[name](c, v))
+
+def run(c, name, mode):
+    m = c.m
+    k = kind(name) if name in READS or name in WRITES or name in RMWS or name in UNSTABLE else None
+    if mode == 'imm':
+        READS[name](c, c.fetch())
+    elif mode == 'zp':
+        operate(c, name, c.fetch())
+    elif mode in ('zpx', 'zpy'):
+        z = c.fetch(); m.read(z)
+        operate(c, name, (z + (c.x if mode == 'zpx' else c.y)) & 0xFF)
+    elif mode == 'abs':
+        lo = c.fetch(); hi = c.fetch(); operate(c, name, hi << 8 | lo)
+    elif mode in ('absx', 'absy'):
+        lo = c.fetch(); hi = c.fetch()
+        idx = c.x if mode == 'absx' else c.y
+        base = hi << 8 | lo; addr = (base + idx) & 0xFFFF
+        crossed = (lo + idx) > 0xFF
+        wrong = (hi << 8) | ((lo + idx) & 0xFF)
+        if k == READ:
+            if crossed: m.read(wrong)
+            operate(c, name, addr)
+        else:
+            m.read(wrong); operate(c, name, addr, hi, crossed)
+    elif mode == 'indx':
+        z = c.fetch(); m.read(z); p = (z + c.x) & 0xFF
+        lo = m.read(p); hi = m.read((p + 1) & 0xFF)
+        operate(c, name, hi << 8 | lo)
+    elif mode == 'indy':
+        z = c.fetch(); lo = m.read(z); hi = m.read((z + 1) & 0xFF)
+        addr = ((hi << 8 | lo) + c.y) & 0xFFFF
+        crossed = (lo + c.y) > 0xFF
+        wrong = (hi << 8) | ((lo + c.y) & 0xFF)
+        if k == READ:
+            if crossed: m.read(wrong)
+            operate(c, name, addr)
+        else:
+            m.read(wrong); operate(c, name, addr, hi, crossed)
+    else:
+        raise Exception(mode)
+
+IMPLIED = {
+    'CLC': lambda c: c.setf(C, 0), 'SEC': lambda c: c.setf(C, 1),
+    'CLI': lambda c: c.setf(I, 0), 'SEI': lambda c: c.setf(I, 1),
+    'CLD': lambda c: c.setf(D, 0), 'SED': lambda c: c.setf(D, 1),
+    'CLV': lambda c: c.setf(V, 0),
+    'TAX': lambda c: setattr(c, 'x', c.nz(c.a)),
+    'TAY': lambda c: setattr(c, 'y', c.nz(c.a)),
+    'TXA': lambda c: setattr(c, 'a', c.nz(c.x)),
+    'TYA': lambda c: setattr(c, 'a', c.nz(c.y)),
+    'TSX': lambda c: setattr(c, 'x', c.nz(c.s)),
+    'TXS': lambda c: setattr(c, 's', c.x),
+    'INX': lambda c: setattr(c, 'x', c.nz(c.x + 1)),
+    'INY': lambda c: setattr(c, 'y', c.nz(c.y + 1)),
+    'DEX': lambda c: setattr(c, 'x', c.nz(c.x - 1)),
+    'DEY': lambda c: setattr(c, 'y', c.nz(c.y - 1)),
+    'NOP': lambda c: None,
+    'ASL': lambda c: setattr(c, 'a', asl(c, c.a)),
+    'LSR': lambda c: setattr(c, 'a', lsr(c, c.a)),
+    'ROL': lambda c: setattr(c, 'a', rol(c, c.a)),
+    'ROR': lambda c: setattr(c, 'a', ror(c, c.a)),
+}
+BRANCHES = {0x10: (N, 0), 0x30: (N, 1), 0x50: (V, 0), 0x70: (V, 1),
+            0x90: (C, 0), 0xB0: (C, 1), 0xD0: (Z, 0), 0xF0: (Z, 1)}
+
+def step(c, op, table):
+    m = c.m
+    c.fetch()
+    if op in BRANCHES:
+        f, want = BRANCHES[op]
+        off = c.fetch()
+        if bool(c.p & f) == bool(want):
+            m.read(c.pc)
+            new = (c.pc + (off - 256 if off & 0x80 else off)) & 0xFFFF
+            if (new ^ c.pc) & 0xFF00:
+                m.read((c.pc & 0xFF00) | (new & 0xFF))
+            c.pc = new
+        return
+    name, mode = table[op]
+    if mode == 'imp':
+        m.read(c.pc); IMPLIED[name](c); return
+    if name == 'BRK':
+        m.read(c.pc); c.pc = (c.pc + 1) & 0xFFFF
+        c.push(c.pc >> 8); c.push(c.pc & 0xFF); c.push(c.p | B | U)
+        lo = m.read(0xFFFE); c.setf(I, 1); hi = m.read(0xFFFF)
+        c.pc = hi << 8 | lo; return
+    if name == 'JSR':
+        lo = c.fetch(); m.read(0x100 + c.s)
+        c.push(c.pc >> 8); c.push(c.pc & 0xFF)
+        hi = m.read(c.pc); c.pc = hi << 8 | lo; return
+    if name == 'RTS':
+        m.read(c.pc); m.read(0x100 + c.s)
+        lo = c.pull(); hi = c.pull(); c.pc = hi << 8 | lo
+        m.read(c.pc); c.pc = (c.pc + 1) & 0xFFFF; return
+    if name == 'RTI':
+        m.read(c.pc); m.read(0x100 + c.s)
+        c.p = (c.pull() & ~B) | U
+        lo = c.pull(); hi = c.pull(); c.pc = hi << 8 | lo; return
+    if name in ('PHA', 'PHP'):
+        m.read(c.pc); c.push(c.a if name == 'PHA' else c.p | B | U); return
+    if name in ('PLA', 'PLP'):
+        m.read(c.pc); m.read(0x100 + c.s); v = c.pull()
+        if name == 'PLA': c.a = c.nz(v)
+        else: c.p = (v & ~B) | U
+        return
+    if name == 'JMP' and mode == 'abs':
+        lo = c.fetch(); hi = m.read(c.pc); c.pc = hi << 8 | lo; return
+    if name == 'JMP':
+        lo = c.fetch(); hi = c.fetch(); p = hi << 8 | lo
+        tlo = m.read(p); thi = m.read((p & 0xFF00) | ((p + 1) & 0xFF))
+        c.pc = thi << 8 | tlo; return
+    run(c, name, mode)
+
+def build_table():
+    t = {}
+    def add(name, pairs):
+        for op, mode in pairs: t[op] = (name, mode)
+    std = lambda base: [(base + 0x09, 'imm'), (base + 0x05, 'zp'), (base + 0x15, 'zpx'),
+                        (base + 0x0D, 'abs'), (base + 0x1D, 'absx'), (base + 0x19, 'absy'),
+                        (base + 0x01, 'indx'), (base + 0x11, 'indy')]
+    for name, base in [('ORA', 0x00), ('AND', 0x20), ('EOR', 0x40), ('ADC', 0x60),
+                       ('LDA', 0xA0), ('CMP', 0xC0), ('SBC', 0xE0)]:
+        add(name, std(base))
+    add('STA', [(o, m) for o, m in std(0x80) if m != 'imm'])
+    for name, base in [('ASL', 0x00), ('ROL', 0x20), ('LSR', 0x40), ('ROR', 0x60)]:
+        add(name, [(base + 0x06, 'zp'), (base + 0x16, 'zpx'), (base + 0x0E, 'abs'), (base + 0x1E, 'absx')])
+        t[base + 0x0A] = (name, 'imp')
+    add('INC', [(0xE6, 'zp'), (0xF6, 'zpx'), (0xEE, 'abs'), (0xFE, 'absx')])
+    add('DEC', [(0xC6, 'zp'), (0xD6, 'zpx'), (0xCE, 'abs'), (0xDE, 'absx')])
+    add('LDX', [(0xA2, 'imm'), (0xA6, 'zp'), (0xB6, 'zpy'), (0xAE, 'abs'), (0xBE, 'absy')])
+    add('LDY', [(0xA0, 'imm'), (0xA4, 'zp'), (0xB4, 'zpx'), (0xAC, 'abs'), (0xBC, 'absx')])
+    add('STX', [(0x86, 'zp'), (0x96, 'zpy'), (0x8E, 'abs')])
+    add('STY', [(0x84, 'zp'), (0x94, 'zpx'), (0x8C, 'abs')])
+    add('CPX', [(0xE0, 'imm'), (0xE4, 'zp'), (0xEC, 'abs')])
+    add('CPY', [(0xC0, 'imm'), (0xC4, 'zp'), (0xCC, 'abs')])
+    add('BIT', [(0x24, 'zp'), (0x2C, 'abs')])
+    for op, name in [(0x18, 'CLC'), (0x38, 'SEC'), (0x58, 'CLI'), (0x78, 'SEI'), (0xB8, 'CLV'),
+                     (0xD8, 'CLD'), (0xF8, 'SED'), (0xAA, 'TAX'), (0xA8, 'TAY'), (0x8A, 'TXA'),
+                     (0x98, 'TYA'), (0xBA, 'TSX'), (0x9A, 'TXS'), (0xE8, 'INX'), (0xC8, 'INY'),
+                     (0xCA, 'DEX'), (0x88, 'DEY'), (0xEA, 'NOP')]:
+        t[op] = (name, 'imp')
+    for op, name in [(0x00, 'BRK'), (0x20, 'JSR'), (0x40, 'RTI'), (0x60, 'RTS'), (0x48, 'PHA'),
+                     (0x08, 'PHP'), (0x68, 'PLA'), (0x28, 'PLP')]:
+        t[op] = (name, None)
+    t[0x4C] = ('JMP', 'abs'); t[0x6C] = ('JMP', 'ind')
+    # Unofficial
+    for name, base in [('SLO', 0x03), ('RLA', 0x23), ('SRE', 0x43), ('RRA', 0x63),
+                       ('DCP', 0xC3), ('ISB', 0xE3)]:
+        add(name, [(base, 'indx'), (base + 0x04, 'zp'), (base + 0x0C, 'abs'), (base + 0x10, 'indy'),
+                   (base + 0x14, 'zpx'), (base + 0x18, 'absy'), (base + 0x1C, 'absx')])
+    add('SAX', [(0x83, 'indx'), (0x87, 'zp'), (0x8F, 'abs'), (0x97, 'zpy')])
+    add('LAX', [(0xA3, 'indx'), (0xA7, 'zp'), (0xAF, 'abs'), (0xB3, 'indy'), (0xB7, 'zpy'), (0xBF, 'absy')])
+    for op in (0x1A, 0x3A, 0x5A, 0x7A, 0xDA, 0xFA): t[op] = ('NOP', 'imp')
+    for op in (0x80, 0x82, 0x89, 0xC2, 0xE2): t[op] = ('NOP', 'imm')
+    for op in (0x04, 0x44, 0x64): t[op] = ('NOP', 'zp')
+    for op in (0x14, 0x34, 0x54, 0x74, 0xD4, 0xF4): t[op] = ('NOP', 'zpx')
+    t[0x0C] = ('NOP', 'abs')
+    for op in (0x1C, 0x3C, 0x5C, 0x7C, 0xDC, 0xFC): t[op] = ('NOP', 'absx')
+    t[0x0B] = ('ANC', 'imm'); t[0x2B] = ('ANC', 'imm'); t[0x4B] = ('ALR', 'imm')
+    t[0x6B] = ('ARR', 'imm'); t[0xCB] = ('AXS', 'imm'); t[0xEB] = ('SBC', 'imm')
+    t[0xBB] = ('LAS', 'absy')
+    t[0x93] = ('SHA', 'indy'); t[0x9F] = ('SHA', 'absy'); t[0x9E] = ('SHX', 'absy')
+    t[0x9C] = ('SHY', 'absx'); t[0x9B] = ('TAS', 'absy')
+    return t
+
+def gen(op, table, rng, count):
+    tests = []
+    for n in range(count):
+        m = Mem(rng)
+        st = [rng.randrange(0x10000), rng.randrange(256), rng.randrange(256),
+              rng.randrange(256), rng.randrange(256), (rng.randrange(256) & ~B) | U]
+        m.preset(st[0], op)
+        c = Cpu(m, st)
+        step(c, op, table)
+        init = sorted(m.init.items())
+        fin = sorted((a, m.cur[a]) for a in set(m.init) | set(m.cur))
+        name = ' '.join('%02x' % m.init.get((st[0] + i) & 0xFFFF, 0) for i in range(3))
+        tests.append({"name": name,
+                      "initial": {"pc": st[0], "s": st[1], "a": st[2], "x": st[3], "y": st[4], "p": st[5],
+                                  "ram": [list(e) for e in init]},
+                      "final": {"pc": c.pc, "s": c.s, "a": c.a, "x": c.x, "y": c.y, "p": c.p,
+                                "ram": [list(e) for e in fin]},
+                      "cycles": m.cycles})
+    return tests
+
+if __name__ == '__main__':
+    out = sys.argv[1]; count = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+    os.makedirs(out, exist_ok=True)
+    table = build_table()
+    for op in sorted(set(table) | set(BRANCHES)):
+        rng = random.Random(0x6502 * 256 + op)
+        tests = gen(op, table, rng, count)
+        with open(os.path.join(out, '%02x.json' % op), 'w') as f:
+            f.write('[\n' + ',\n'.join(json.dumps(t) for t in tests) + '\n]\n')